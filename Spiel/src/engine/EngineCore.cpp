@@ -54,6 +54,8 @@ void EngineCore::run() {
 		}
 		deltaTimeQueue.push_front(deltaTime);
 
+		JobSystem::resetFrameArenas();	// all transient memory of the last frame is released here
+
 		update(getDeltaTimeSafe());
 
 		// update rendering:
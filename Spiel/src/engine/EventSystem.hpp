@@ -5,11 +5,125 @@
 #include <functional>
 #include <any>
 #include <set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <span>
+#include <cassert>
 
 #include "types/ShortNames.hpp"
+#include "types/MPSCQueue.hpp"
+
+class EventChannelBase {
+public:
+	virtual ~EventChannelBase() = default;
+};
+
+/**
+ * Queue of events of one type.
+ * Events can be emitted from any thread and from jobs, emitting is lock-free as long as the queue has space.
+ * If the queue runs full, events go into an overflow buffer behind a mutex, so no event is ever lost,
+ * and the queue grows to fit the whole batch on the next drain.
+ * The order of events from different threads is unspecified.
+ */
+template<typename T>
+class EventChannel : public EventChannelBase {
+public:
+	EventChannel(size_t capacity = 1024) : queue{ capacity } {}
+
+	void emit(T const& event)
+	{
+		if (!queue.tryPush(event)) {
+			std::unique_lock lock(overflowMut);
+			overflow.push_back(event);
+		}
+	}
+	void emit(T&& event)
+	{
+		if (!queue.tryPush(std::move(event))) {
+			std::unique_lock lock(overflowMut);
+			overflow.push_back(std::move(event));
+		}
+	}
+
+	/**
+	 * Collects every event emitted since the last drain.
+	 * Must only be called at a sync point, where no thread emits into this channel.
+	 * 
+	 * \return the batch of events, valid until the next drain.
+	 */
+	std::span<const T> drain()
+	{
+		batch.clear();
+		T event;
+		while (queue.tryPop(event)) {
+			batch.push_back(std::move(event));
+		}
+		if (!overflow.empty()) {
+			batch.insert(batch.end(), std::make_move_iterator(overflow.begin()), std::make_move_iterator(overflow.end()));
+			overflow.clear();
+			queue.reset(batch.size() * 2);
+		}
+		return { batch.data(), batch.size() };
+	}
+
+	size_t capacity() const { return queue.capacity(); }
+private:
+	MPSCQueue<T> queue;
+	std::mutex overflowMut;
+	std::vector<T> overflow;
+	std::vector<T> batch;
+};
 
 class EventSystem {
 public:
+	/**
+	 * Creates the channel for the event type T.
+	 * Channels must be registered before any thread emits into them, typically at startup.
+	 * 
+	 * \param capacity amount of events that can be emitted per frame without taking the overflow lock.
+	 */
+	template<typename T>
+	EventChannel<T>& registerChannel(size_t capacity = 1024)
+	{
+		const u32 id = channelId<T>();
+		if (id >= channels.size()) {
+			channels.resize(id + 1);
+		}
+		assert(!channels[id]);
+		channels[id] = std::make_unique<EventChannel<T>>(capacity);
+		return static_cast<EventChannel<T>&>(*channels[id]);
+	}
+
+	template<typename T>
+	EventChannel<T>& channel()
+	{
+		const u32 id = channelId<T>();
+		assert(id < channels.size() && channels[id]);
+		return static_cast<EventChannel<T>&>(*channels[id]);
+	}
+
+	/**
+	 * Can be called from any thread.
+	 */
+	template<typename T>
+	void emit(T&& event)
+	{
+		channel<std::remove_cvref_t<T>>().emit(std::forward<T>(event));
+	}
+
+	/**
+	 * Must only be called at a sync point, where no thread emits events of type T.
+	 * 
+	 * \return all events of type T emitted since the last drain, valid until the next drain.
+	 */
+	template<typename T>
+	std::span<const T> drain()
+	{
+		return channel<T>().drain();
+	}
+
 	template<typename T>
 	using Callback = std::function<bool(T&)>;
 
@@ -41,6 +155,16 @@ public:
 		}
 	}
 private:
+	static inline std::atomic<u32> nextChannelId{ 0 };
+	template<typename T>
+	static u32 channelId()
+	{
+		static const u32 id = nextChannelId++;
+		return id;
+	}
+
+	std::vector<std::unique_ptr<EventChannelBase>> channels;
+
 	std::unordered_map<std::string_view, std::any> events;
 	std::set<uint32_t> killSet;
 };
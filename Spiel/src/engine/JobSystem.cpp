@@ -27,6 +27,12 @@ void JobSystem::initialize()
 	assert(state == State::Uninitialized);
 	state = State::Running;
 
+	frameArenas.clear();
+	for (uint32_t id = 0; id < threadCount + 1; ++id) {
+		frameArenas.push_back(std::make_unique<FrameArena>());
+	}
+	FrameArena::bindToThread(frameArenas[threadCount].get());
+
 	threads.reserve(threadCount);
 	for (uint32_t id = 0; id < threadCount; ++id) {
 		threads.push_back(std::thread(workerFunction, id));
@@ -46,6 +52,26 @@ void JobSystem::reset()
 	threads.clear();
 }
 
+void JobSystem::resetFrameArenas()
+{
+	for (auto& arena : frameArenas) {
+		arena->reset();
+	}
+}
+
+FrameArena::Stats JobSystem::frameArenaStats()
+{
+	FrameArena::Stats acc;
+	for (auto& arena : frameArenas) {
+		const auto stats = arena->getStats();
+		acc.usedBytes += stats.usedBytes;
+		acc.lastFrameUsedBytes += stats.lastFrameUsedBytes;
+		acc.highWaterMark += stats.highWaterMark;
+		acc.capacity += stats.capacity;
+	}
+	return acc;
+}
+
 void JobSystem::orphan(Tag tag)
 {
 	std::unique_lock lock(mut);
@@ -78,6 +104,7 @@ void JobSystem::deleteJobBatch(Tag tag)
 void JobSystem::workerFunction(const uint32_t id)
 {
 	std::unique_lock lock(mut);
+	FrameArena::bindToThread(frameArenas[id].get());
 	for (;;) {
 		workerCV.wait(lock,
 			[&]() {
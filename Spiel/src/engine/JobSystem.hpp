@@ -9,6 +9,11 @@
 #include <unordered_map>
 #include <cassert>
 #include <functional>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+
+#include "allocator/ArenaAllocatorPerThread.hpp"
 
 // TODO maybe move it into some sort of reflection hpp
 template<typename T>
@@ -151,6 +156,172 @@ public:
 	 */
 	static size_t workerCount() { return threadCount; }
 
+	/**
+	 * \param count of elements to process.
+	 * \param minChunkSize minimal count of elements one chunk should process, so that small workloads are not split into too many jobs.
+	 * \return count of chunks to split the elements into for parallelForChunks, 0 if there are no elements.
+	 */
+	static size_t chunkCount(const size_t count, const size_t minChunkSize)
+	{
+		const size_t maxChunks = threadCount * CHUNKS_PER_WORKER;
+		const size_t chunkSize = std::max(minChunkSize, size_t(1));
+		return std::min(maxChunks, (count + chunkSize - 1) / chunkSize);
+	}
+
+	/**
+	 * Splits the index range [0,count) into the given number of equally sized chunks and processes every chunk in its own job.
+	 * The chunk ranges only depend on count and chunks, so per chunk data (like histograms) can be indexed by the chunk.
+	 * Waits until all chunks are processed.
+	 * Must not be called from inside a job.
+	 *
+	 * \param function callable with signature void(size_t chunk, size_t begin, size_t end, uint32_t threadId).
+	 */
+	template<typename F>
+	static void parallelForChunks(const size_t count, const size_t chunks, F&& function)
+	{
+		if (count == 0 || chunks == 0) return;
+		std::vector<LambdaJob> jobs;
+		jobs.reserve(chunks);
+		for (size_t chunk = 0; chunk < chunks; ++chunk) {
+			const size_t begin = count * chunk / chunks;
+			const size_t end = count * (chunk + 1) / chunks;
+			jobs.push_back(LambdaJob([&function, chunk, begin, end](uint32_t threadId) { function(chunk, begin, end, threadId); }));
+		}
+		wait(submitVec(std::move(jobs)));
+	}
+
+	/**
+	 * Processes the index range [0,count) in parallel chunks of at least minChunkSize elements.
+	 * Waits until all chunks are processed.
+	 * Must not be called from inside a job.
+	 *
+	 * \param function callable with signature void(size_t begin, size_t end, uint32_t threadId).
+	 */
+	template<typename F>
+	static void parallelFor(const size_t count, const size_t minChunkSize, F&& function)
+	{
+		parallelForChunks(count, chunkCount(count, minChunkSize),
+			[&function](size_t chunk, size_t begin, size_t end, uint32_t threadId) { function(begin, end, threadId); });
+	}
+
+	/**
+	 * Sorts the range with the given comparator.
+	 * The range is split into chunks that are sorted in parallel, neighbouring sorted runs are then merged in parallel rounds.
+	 * Must not be called from inside a job.
+	 *
+	 * \param minChunkSize ranges smaller than this are sorted on the calling thread.
+	 */
+	template<typename RandomIt, typename Compare>
+	static void parallelSort(RandomIt first, RandomIt last, Compare compare, const size_t minChunkSize)
+	{
+		const size_t count = size_t(last - first);
+		const size_t chunks = chunkCount(count, minChunkSize);
+		if (chunks <= 1) {
+			std::sort(first, last, compare);
+			return;
+		}
+		parallelForChunks(count, chunks,
+			[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+				std::sort(first + begin, first + end, compare);
+			}
+		);
+		// merge the runs pairwise, every round halves the run count:
+		for (size_t runsPerMerge = 1; runsPerMerge < chunks; runsPerMerge *= 2) {
+			const size_t merges = (chunks + 2 * runsPerMerge - 1) / (2 * runsPerMerge);
+			parallelForChunks(merges, merges,
+				[&](size_t merge, size_t, size_t, uint32_t threadId) {
+					const size_t firstRun = merge * 2 * runsPerMerge;
+					const size_t middleRun = std::min(firstRun + runsPerMerge, chunks);
+					const size_t endRun = std::min(firstRun + 2 * runsPerMerge, chunks);
+					std::inplace_merge(
+						first + count * firstRun / chunks,
+						first + count * middleRun / chunks,
+						first + count * endRun / chunks,
+						compare
+					);
+				}
+			);
+		}
+	}
+
+	/**
+	 * Replaces every element of the range with the sum of all elements before it (exclusive prefix sum).
+	 * The sums of the chunks are computed in parallel, then every chunk is scanned in parallel, starting at the sum of the chunks before it.
+	 * Must not be called from inside a job.
+	 *
+	 * \param minChunkSize minimal count of elements one chunk should process.
+	 * \param chunkOffsets scratch buffer for the sums of the chunks, a buffer that is kept by the caller does not allocate after the first call.
+	 * \return sum of all elements.
+	 */
+	template<typename RandomIt>
+	static auto parallelExclusiveScan(RandomIt first, RandomIt last, const size_t minChunkSize, std::vector<typename std::iterator_traits<RandomIt>::value_type>& chunkOffsets)
+	{
+		using T = typename std::iterator_traits<RandomIt>::value_type;
+		const size_t count = size_t(last - first);
+		const size_t chunks = chunkCount(count, minChunkSize);
+		chunkOffsets.assign(chunks, T{});
+		parallelForChunks(count, chunks,
+			[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+				T sum{};
+				for (size_t i = begin; i < end; ++i) {
+					sum += first[i];
+				}
+				chunkOffsets[chunk] = sum;
+			}
+		);
+		T total{};
+		for (T& offset : chunkOffsets) {
+			const T sum = offset;
+			offset = total;
+			total += sum;
+		}
+		parallelForChunks(count, chunks,
+			[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+				T running = chunkOffsets[chunk];
+				for (size_t i = begin; i < end; ++i) {
+					const T value = first[i];
+					first[i] = running;
+					running += value;
+				}
+			}
+		);
+		return total;
+	}
+
+	/**
+	 * Every worker owns a FrameArena for transient memory, jobs get theirs via the threadId passed to execute.
+	 * The arena is also bound to the worker thread, so FrameArena::local() returns the same arena.
+	 * Memory from a frame arena must not be used after the next resetFrameArenas(), 
+	 * so jobs that run longer than one frame must not allocate from it.
+	 * 
+	 * \param threadId the id a job gets in execute.
+	 * \return frame arena of the worker.
+	 */
+	static FrameArena& frameArena(const uint32_t threadId)
+	{
+		assert(threadId < threadCount);
+		return *frameArenas[threadId];
+	}
+
+	/**
+	 * \return frame arena of the thread that called initialize().
+	 */
+	static FrameArena& mainThreadFrameArena()
+	{
+		return *frameArenas[threadCount];
+	}
+
+	/**
+	 * Releases the memory of all frame arenas. Called once per frame by the engine loop.
+	 * No job may use frame arena memory while this is called.
+	 */
+	static void resetFrameArenas();
+
+	/**
+	 * \return the sum of the statistics of all frame arenas.
+	 */
+	static FrameArena::Stats frameArenaStats();
+
 private:
 
 	/**
@@ -212,8 +383,10 @@ private:
 		Uninitialized,
 		Running
 	};
+	static const size_t CHUNKS_PER_WORKER = 4;	// more chunks than workers balance out chunks of uneven cost
 	inline static const size_t threadCount{ std::max(std::thread::hardware_concurrency()-1, 1u) };	// the worker count is only n-1 hardwarethreads, as we dont want to pollute the os with threads.
 	inline static std::vector<std::thread> threads;
+	inline static std::vector<std::unique_ptr<FrameArena>> frameArenas;	// one per worker + one for the main thread, created in initialize
 
 	inline static std::mutex mut;						// central syncronization mutex used for every read wnad write to the fields below:
 	/// 
@@ -1,64 +1,167 @@
 #pragma once
 
 #include <memory>
-#include <iostream>
-#include <mutex>
-#include <thread>
+#include <vector>
+#include <cassert>
+#include <cinttypes>
+#include <algorithm>
 
 #include "../types/ShortNames.hpp"
 
-class PerThreadSharedArenaAllocatorStaticData {
+/**
+ * Bump allocator for transient memory that lives at most until the end of the current frame.
+ * Allocating is a pointer increment, deallocating does nothing; all memory is released at once by reset().
+ * A FrameArena must only be used by one thread at a time.
+ * When a frame needs more than the current capacity, additional blocks are allocated.
+ * On the next reset, the blocks are merged into one block, so in steady state no heap allocations happen at all.
+ */
+class FrameArena {
+public:
+	static constexpr size_t DEFAULT_CAPACITY{ 1 << 20 };	// 1 MB
+
+	struct Stats {
+		size_t usedBytes{ 0 };				// bytes allocated in the current frame
+		size_t lastFrameUsedBytes{ 0 };		// bytes allocated in the previous frame
+		size_t highWaterMark{ 0 };			// maximum of bytes ever allocated in one frame
+		size_t capacity{ 0 };				// bytes reserved by the arena
+	};
+
+	FrameArena(size_t capacity = DEFAULT_CAPACITY)
+	{
+		blocks.push_back(Block(capacity));
+	}
+
+	void* allocate(size_t size, size_t alignment)
+	{
+		if (void* ptr = allocateInBlock(blocks[currentBlock], size, alignment)) {
+			return ptr;
+		}
+		return allocateInNewBlock(size, alignment);
+	}
+
+	/**
+	 * releases all memory allocated since the last reset.
+	 * Every pointer into the arena is invalid after the call.
+	 */
+	void reset()
+	{
+		stats.lastFrameUsedBytes = usedBytes();
+		stats.highWaterMark = std::max(stats.highWaterMark, stats.lastFrameUsedBytes);
+		if (blocks.size() > 1) {
+			size_t capacity{ 0 };
+			for (auto& block : blocks) capacity += block.size;
+			blocks.clear();
+			blocks.push_back(Block(capacity));
+		}
+		currentBlock = 0;
+		offset = 0;
+		bytesInPreviousBlocks = 0;
+	}
+
+	Stats getStats() const
+	{
+		Stats ret = stats;
+		ret.usedBytes = usedBytes();
+		ret.highWaterMark = std::max(ret.highWaterMark, ret.usedBytes);
+		ret.capacity = 0;
+		for (auto& block : blocks) ret.capacity += block.size;
+		return ret;
+	}
+
+	/**
+	 * \return the arena bound to the calling thread.
+	 * JobSystem binds one arena to each worker and one to the thread that initialized it.
+	 */
+	static FrameArena& local()
+	{
+		assert(localArena);
+		return *localArena;
+	}
+
+	static void bindToThread(FrameArena* arena)
+	{
+		localArena = arena;
+	}
 private:
-	template<typename T>
-	friend class PerThreadSharedArenaAllocatorInterface;
+	struct Block {
+		Block(size_t size) : memory{ std::make_unique<u8[]>(size) }, size{ size } {}
+		std::unique_ptr<u8[]> memory;
+		size_t size;
+	};
 
-	static inline std::mutex mut;
+	size_t usedBytes() const
+	{
+		return bytesInPreviousBlocks + offset;
+	}
 
-	static inline constexpr size_t MAX_SIZE{ 2 << 20 };	// 1 MB
+	void* allocateInBlock(Block& block, size_t size, size_t alignment)
+	{
+		const uintptr_t begin = reinterpret_cast<uintptr_t>(block.memory.get());
+		const uintptr_t aligned = (begin + offset + alignment - 1) & ~(uintptr_t(alignment) - 1);
+		const size_t newOffset = (aligned - begin) + size;
+		if (newOffset > block.size) {
+			return nullptr;
+		}
+		offset = newOffset;
+		return reinterpret_cast<void*>(aligned);
+	}
 
-	static inline u8 data[MAX_SIZE];
-	static inline size_t currentEndOffset{ 0 };
-	static inline size_t allocatedObjects{ 0 };
+	void* allocateInNewBlock(size_t size, size_t alignment)
+	{
+		bytesInPreviousBlocks += offset;
+		offset = 0;
+		currentBlock += 1;
+		if (currentBlock == blocks.size()) {
+			blocks.push_back(Block(std::max(blocks.back().size * 2, size + alignment)));
+		}
+		void* ptr = allocateInBlock(blocks[currentBlock], size, alignment);
+		return ptr ? ptr : allocateInNewBlock(size, alignment);
+	}
+
+	static inline thread_local FrameArena* localArena{ nullptr };
+
+	std::vector<Block> blocks;
+	size_t currentBlock{ 0 };
+	size_t offset{ 0 };
+	size_t bytesInPreviousBlocks{ 0 };
+	Stats stats;
 };
 
+/**
+ * std compatible allocator, that allocates from a FrameArena.
+ * Containers using it must not outlive the frame they were created in.
+ */
 template<typename T>
-struct PerThreadSharedArenaAllocatorInterface {
-private:
-	using Data = SharedArenaAllocatorStaticData;
+class FrameAllocator {
 public:
-
-	/* Interface: */
+	template<typename U>
+	friend class FrameAllocator;
 
 	using value_type = T;
 	using size_type = std::size_t;
 	using difference_type = std::ptrdiff_t;
 	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
 
-	constexpr value_type* allocate(size_type size)
-	{
-		std::unique_lock lock(Data::mut);
-		const size_t OBJECT_SIZE = sizeof(value_type) * size;
-
-		if (Data::currentEndOffset + OBJECT_SIZE > Data::MAX_SIZE) {
-			throw new std::bad_alloc();
-		}
-
-		u8* ptr = Data::data + Data::currentEndOffset;
-		Data::currentEndOffset += OBJECT_SIZE;
-		Data::allocatedObjects += 1;
-		return reinterpret_cast<value_type*>(ptr);
-	}
+	FrameAllocator() : arena{ &FrameArena::local() } {}
+	FrameAllocator(FrameArena& arena) : arena{ &arena } {}
+	template<typename U>
+	FrameAllocator(FrameAllocator<U> const& other) : arena{ other.arena } {}
 
-	constexpr void deallocate(value_type* p, size_type n)
+	value_type* allocate(size_type n)
 	{
-		std::unique_lock lock(Data::mut);
-		Data::allocatedObjects -= 1;
-		if (Data::allocatedObjects == 0) {
-			Data::currentEndOffset = 0;
-		}
+		return static_cast<value_type*>(arena->allocate(sizeof(value_type) * n, alignof(value_type)));
 	}
 
-	constexpr bool operator==(PerThreadSharedArenaAllocatorInterface<T> const& rhs) const { return true; }
+	void deallocate(value_type* p, size_type n) { /* memory is released on arena reset */ }
 
-	constexpr size_t allocatedObjects() const { return Data::allocatedObjects; }
-};
\ No newline at end of file
+	template<typename U>
+	bool operator==(FrameAllocator<U> const& rhs) const { return arena == rhs.arena; }
+	template<typename U>
+	bool operator!=(FrameAllocator<U> const& rhs) const { return arena != rhs.arena; }
+private:
+	FrameArena* arena;
+};
+
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
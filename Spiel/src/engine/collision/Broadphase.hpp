@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "../../engine/types/BaseTypes.hpp"
+#include "../../engine/math/Vec2.hpp"
+#include "../../engine/entity/EntityTypes.hpp"
+#include "../../engine/rendering/Sprite.hpp"
+#include "../../engine/allocator/ArenaAllocatorPerThread.hpp"
+#include "CoreComponents.hpp"
+
+enum class BroadphaseType : uint8_t {
+	Quadtree,			// rebuilt from scratch every frame
+	LinearQuadtree,		// pointer free quadtree in flat arrays, rebuilt in parallel every frame
+	DynamicAABBTree,	// persistent, only entities that left their fattened aabb are reinserted
+	Grid,				// dense uniform grid over the collider bounds, rebuilt every frame
+	SpatialHash			// hashed uniform grid for unbounded worlds, rebuilt every frame
+};
+
+/**
+ * unordered pair of potentially colliding entities, a < b.
+ */
+struct EntityPair {
+	EntityHandleIndex a;
+	EntityHandleIndex b;
+};
+
+/**
+ * counts of the group mask culling of broadphase querries.
+ */
+struct BroadphaseQuerryStats {
+	size_t culledNodes{ 0 };		// nodes or cells skipped as a whole
+	size_t culledEntities{ 0 };		// single entities skipped
+};
+
+/**
+ * Interface of the spatial acceleration structures of the CollisionSystem.
+ * The CollisionSystem owns one broadphase per collider category (dynamic, static, particle, sensor).
+ * Implementations decide themselfes if they rebuild or patch their structure in update.
+ */
+class Broadphase {
+public:
+	Broadphase(uint8_t colliderTag) :
+		COLLIDER_TAG{ colliderTag }
+	{}
+
+	virtual ~Broadphase() {}
+
+	/**
+	 * Called once per frame, before any querry.
+	 *
+	 * \param entities all entities of the broadphases collider category. Entities that are not in the list anymore are removed.
+	 * \param aabbs aabb sizes, indexed by entity.
+	 * \param minPos minimum of all collider positions.
+	 * \param maxPos maximum of all collider positions.
+	 */
+	virtual void update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos) = 0;
+
+	/**
+	 * appends every entity that could overlap with the given box to rVec.
+	 * An entity may be appended more than once.
+	 * Can be called from multiple threads at the same time.
+	 */
+	void querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize) const
+	{
+		BroadphaseQuerryStats stats;
+		querry(rVec, qryPos, qrySize, 0, stats);
+	}
+
+	/**
+	 * like querry, but entities whose groupMask intersects ignoreGroupMask are skipped.
+	 * Nodes store the group bits that all of their entities share (the AND of their group masks), 
+	 * so a subtree whose shared bits intersect ignoreGroupMask is skipped without visiting its entities.
+	 * The OR of the masks would not work here: it only tells that some entity of the subtree is ignored, not that all of them are.
+	 * 
+	 * \param stats the culled nodes and entities are added to it.
+	 */
+	virtual void querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const = 0;
+
+	virtual void querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const = 0;
+
+	const uint8_t COLLIDER_TAG;
+};
@@ -3,39 +3,133 @@
 CollisionSystem::CollisionSystem(CollisionSECM secm, uint32_t qtreeCapacity) :
 	secm{ secm },
 	qtreeCapacity{ qtreeCapacity },
-	qtreeDynamic({ 0,0 }, { 0,0 }, qtreeCapacity, secm, Collider::DYNAMIC),
-	qtreeStatic({ 0,0 }, { 0,0 }, qtreeCapacity, secm, Collider::STATIC),
-	qtreeParticle({ 0,0 }, { 0,0 }, qtreeCapacity, secm, Collider::PARTICLE),
-	qtreeSensor({ 0,0 }, { 0,0 }, qtreeCapacity, secm, Collider::SENSOR)
+	sweepAndPrune{ secm }
 {
+	setBroadphase(Collider::DYNAMIC | Collider::STATIC | Collider::PARTICLE | Collider::SENSOR, BroadphaseType::Quadtree);
+
 	jobEntityBuffers.push_back(std::make_unique<std::vector<EntityHandleIndex>>());
 
 	for (int i = 0; i < JobSystem::workerCount(); i++) {
 		collisionLists.push_back(std::vector<CollisionInfo>());
+		workerPairs.push_back(std::vector<EntityPair>());
+		workerMaskStats.push_back(GroupMaskCullingStats());
+		workerTriggerCandidates.push_back(std::vector<uint64_t>());
+		workerSDFInfos.push_back(std::vector<CollisionInfo>());
 	}
+
+	secm.attachEventQueue<Collider>(colliderEvents);
+	secm.attachEventQueue<PhysicsBody>(physicsBodyEvents);
+	secm.attachEventQueue<Movement>(movementEvents);
 }
 
-void CollisionSystem::execute(CollisionSECM secm, float deltaTime)
+CollisionSystem::~CollisionSystem()
 {
-	prepare(secm);
-	collisionDetection(secm);
+	secm.detachEventQueue<Collider>(colliderEvents);
+	secm.detachEventQueue<PhysicsBody>(physicsBodyEvents);
+	secm.detachEventQueue<Movement>(movementEvents);
 }
 
-std::vector<std::vector<CollisionInfo>>& CollisionSystem::getCollisionsLists()
+void CollisionSystem::execute(CollisionSECM secm, float deltaTime)
 {
-	return collisionLists;
+	prepare(secm);
+	narrowphaseStats = {};
+	switch (detectionMode) {
+	case CollisionDetectionMode::Querries:
+		collisionDetection(secm);
+		if (sensorTriggers) querrySensorCandidates(secm);
+		break;
+	case CollisionDetectionMode::UniquePairs:
+		findPairsFromQuerries(secm);
+		if (sensorTriggers) querrySensorCandidates(secm);
+		pairCollisionDetection(secm);
+		break;
+	case CollisionDetectionMode::SweepAndPrune:
+		sweepAndPrune.findPairs(pairs);
+		// the statics find the sleeping dynamics in the sweep, these pairs are not tested:
+		std::erase_if(pairs, [&](const EntityPair& pair) { return isResting(pair.a) && isResting(pair.b); });
+		if (sensorTriggers) extractSensorPairs();
+		pairCollisionDetection(secm);
+		break;
+	}
+	if (sensorTriggers) triggerDetection(secm);
+	groupMaskCullingStats = {};
+	for (const auto& stats : workerMaskStats) {
+		groupMaskCullingStats.culledNodes += stats.culledNodes;
+		groupMaskCullingStats.culledEntities += stats.culledEntities;
+		groupMaskCullingStats.rejectedCandidates += stats.rejectedCandidates;
+	}
+	compactCollisions(secm);
 }
 
 const CollisionSystem::CollisionsView CollisionSystem::collisions_view(EntityHandleIndex entity)
 {
 	if (auto* token = secm.getIf<CollisionsToken>(entity)) {
-		if (token->workerIndex != -1) {
-			return CollisionsView(token->begin, token->end, collisionLists[token->workerIndex]);
-		}
+		return CollisionsView(token->begin, token->end, collisions);
 	}
 	return CollisionsView(0, 0, dummy);
 }
 
+void CollisionSystem::setBroadphase(uint8_t colliderFlags, BroadphaseType type)
+{
+	if (colliderFlags & Collider::DYNAMIC) { 
+		dynamicBroadphase = makeBroadphase(type, Collider::DYNAMIC);
+		sleepingBroadphase = makeBroadphase(type, Collider::DYNAMIC);
+		rebuildSleeping = true;
+	}
+	if (colliderFlags & Collider::STATIC) { staticBroadphase = makeBroadphase(type, Collider::STATIC); rebuildStatic = true; }
+	if (colliderFlags & Collider::PARTICLE) { particleBroadphase = makeBroadphase(type, Collider::PARTICLE); }
+	if (colliderFlags & Collider::SENSOR) { sensorBroadphase = makeBroadphase(type, Collider::SENSOR); }
+}
+
+void CollisionSystem::setDetectionMode(CollisionDetectionMode mode)
+{
+	detectionMode = mode;
+	pairs.clear();
+}
+
+void CollisionSystem::enableStaticSDF(float cellSize, float band)
+{
+	staticSDF = std::make_unique<StaticSDF>(cellSize, band);
+	staticSDFDirty = true;
+}
+
+void CollisionSystem::disableStaticSDF()
+{
+	staticSDF.reset();
+	sdfCircleCache.clear();
+}
+
+void CollisionSystem::setSensorTriggers(bool enable)
+{
+	sensorTriggers = enable;
+	lastTriggerPairs.clear();
+	triggerEvents.clear();
+}
+
+std::span<const TriggerEvent> CollisionSystem::triggerEvents_view(EntityHandleIndex sensor) const
+{
+	const auto [begin, end] = std::equal_range(triggerEvents.begin(), triggerEvents.end(), TriggerEvent{ sensor, 0, TriggerEventType::Enter },
+		[](const TriggerEvent& a, const TriggerEvent& b) { return a.sensor < b.sensor; });
+	return { triggerEvents.data() + (begin - triggerEvents.begin()), size_t(end - begin) };
+}
+
+std::unique_ptr<Broadphase> CollisionSystem::makeBroadphase(BroadphaseType type, uint8_t colliderTag) const
+{
+	switch (type) {
+	case BroadphaseType::Quadtree:
+		return std::make_unique<Quadtree>(Vec2{ 0,0 }, Vec2{ 0,0 }, qtreeCapacity, secm, colliderTag);
+	case BroadphaseType::LinearQuadtree:
+		return std::make_unique<LinearQuadtree>(secm, colliderTag, qtreeCapacity);
+	case BroadphaseType::DynamicAABBTree:
+		return std::make_unique<DynamicAABBTree>(secm, colliderTag);
+	case BroadphaseType::Grid:
+		return std::make_unique<GridBroadphase>(secm, colliderTag, GridBroadphase::Mode::Dense);
+	case BroadphaseType::SpatialHash:
+		return std::make_unique<GridBroadphase>(secm, colliderTag, GridBroadphase::Mode::Hashed);
+	}
+	throw new std::exception("error: unknown broadphase type");
+}
+
 const std::vector<Sprite>& CollisionSystem::getDebugSprites() const
 {
 	return debugSprites;
@@ -44,109 +138,379 @@ const std::vector<Sprite>& CollisionSystem::getDebugSprites() const
 void CollisionSystem::checkForCollisions(std::vector<CollisionInfo>& collisions, uint8_t colliderType, Transform const& b, Collider const& c) const
 {
 	Vec2 aabb = aabbBounds(c.size, b.rotaVec);
-	std::vector<EntityHandleIndex> near;
-	std::vector<QtreeNodeQuerry> buffer;
-	if (colliderType & Collider::DYNAMIC) {
-		qtreeDynamic.querry(near, buffer, b.position, aabb);
+	FrameVector<EntityHandleIndex> near;
+	collectOverlappingAABBs(near, b.position, aabb, colliderType);
+	FrameVector<CollPoint> verteciesBuffer;
+	generateCollisionInfos2(secm, collisions, aabbCache, near, INVALID_ENTITY_HANDLE_INDEX, b, c, aabb, verteciesBuffer);
+}
+
+void CollisionSystem::collectOverlappingAABBs(FrameVector<EntityHandleIndex>& near, Vec2 position, Vec2 size, uint8_t colliderCategories) const
+{
+	if (detectionMode == CollisionDetectionMode::SweepAndPrune) {
+		sweepAndPrune.querry(near, position, size, colliderCategories);
 	}
-	if (colliderType & Collider::STATIC) {
-		qtreeStatic.querry(near, buffer, b.position, aabb);
+	else {
+		if (colliderCategories & Collider::DYNAMIC) {
+			dynamicBroadphase->querry(near, position, size);
+			sleepingBroadphase->querry(near, position, size);
+		}
+		if (colliderCategories & Collider::STATIC) {
+			staticBroadphase->querry(near, position, size);
+		}
+		if (colliderCategories & Collider::PARTICLE) {
+			particleBroadphase->querry(near, position, size);
+		}
+		if (colliderCategories & Collider::SENSOR) {
+			sensorBroadphase->querry(near, position, size);
+		}
 	}
-	if (colliderType & Collider::PARTICLE) {
-		qtreeParticle.querry(near, buffer, b.position, aabb);
+	// the broadphases may report an entity more than once and only approximate the aabbs:
+	std::sort(near.begin(), near.end());
+	near.erase(std::unique(near.begin(), near.end()), near.end());
+	near.erase(std::remove_if(near.begin(), near.end(),
+		[&](EntityHandleIndex ent) { return !isOverlappingAABB(position, size, secm.getComp<Transform>(ent).position, aabbCache[ent]); }),
+		near.end());
+}
+
+std::optional<CollisionInfo> CollisionSystem::testCollider(Transform const& transform, Collider const& collider, EntityHandleIndex entity, FrameVector<CollPoint>& collPoints) const
+{
+	return generateCollisionInfo(INVALID_ENTITY_HANDLE_INDEX, transform, collider, entity, secm.getComp<Transform>(entity), secm.getComp<Collider>(entity), collPoints);
+}
+
+void CollisionSystem::querryAABB(std::vector<EntityHandleIndex>& result, Vec2 position, Vec2 size, uint8_t colliderCategories) const
+{
+	FrameVector<EntityHandleIndex> near;
+	collectOverlappingAABBs(near, position, size, colliderCategories);
+	result.insert(result.end(), near.begin(), near.end());
+}
+
+void CollisionSystem::querryPoint(std::vector<EntityHandleIndex>& result, Vec2 point, uint8_t colliderCategories) const
+{
+	FrameVector<EntityHandleIndex> near;
+	collectOverlappingAABBs(near, point, Vec2{ 0, 0 }, colliderCategories);
+	for (auto ent : near) {
+		const auto& transform = secm.getComp<Transform>(ent);
+		const auto& collider = secm.getComp<Collider>(ent);
+		bool inside = isPointInShape(CollidableAdapter(transform.position, collider.size, collider.form, transform.rotaVec), point);
+		const auto extraColliders = collider.extraColliders();
+		for (size_t i = 0; i < extraColliders.size() && !inside; ++i) {
+			const auto& extra = extraColliders[i];
+			inside = isPointInShape(CollidableAdapter(transform.position + rotate(extra.relativePos, transform.rotaVec), extra.size, extra.form, transform.rotaVec * extra.relativeRota), point);
+		}
+		if (inside) {
+			result.push_back(ent);
+		}
 	}
-	if (colliderType & Collider::SENSOR) {
-		qtreeSensor.querry(near, buffer, b.position, aabb);
+}
+
+void CollisionSystem::querryCircle(std::vector<EntityHandleIndex>& result, Vec2 center, float radius, uint8_t colliderCategories) const
+{
+	querryShape(result, Transform(center, 0), Collider(Vec2{ radius * 2.0f, radius * 2.0f }, Form::Circle), colliderCategories);
+}
+
+void CollisionSystem::querryShape(std::vector<EntityHandleIndex>& result, Transform const& transform, Collider const& collider, uint8_t colliderCategories) const
+{
+	FrameVector<EntityHandleIndex> near;
+	collectOverlappingAABBs(near, transform.position, colliderAABB(transform, collider), colliderCategories);
+	FrameVector<CollPoint> collPoints;
+	for (auto ent : near) {
+		if (testCollider(transform, collider, ent, collPoints)) {
+			result.push_back(ent);
+		}
 	}
-	std::vector<CollPoint> verteciesBuffer;
-	generateCollisionInfos2(secm, collisions, aabbCache, near, INVALID_ENTITY_HANDLE_INDEX, b, c, aabb, verteciesBuffer);
 }
 
-inline size_t CollisionSystem::collisionCount() const
+std::optional<QueryHit> CollisionSystem::raycast(Vec2 origin, Vec2 end, uint8_t colliderCategories) const
 {
-	size_t acc = 0;
-	for (auto& c : collisionLists) acc += c.size();
-	return acc;
+	const Vec2 delta = end - origin;
+	FrameVector<EntityHandleIndex> near;
+	collectOverlappingAABBs(near, (origin + end) * 0.5f, abs(delta), colliderCategories);
+
+	std::optional<QueryHit> hit;
+	for (auto ent : near) {
+		const auto& transform = secm.getComp<Transform>(ent);
+		const auto& collider = secm.getComp<Collider>(ent);
+		auto testShape = [&](CollidableAdapter const& shape) {
+			// near is sorted, so on equal fractions the smaller entity wins:
+			if (auto intersection = intersectRayShape(shape, origin, delta, hit ? hit->fraction : 1.0f)) {
+				if (!hit || intersection->fraction < hit->fraction) {
+					hit = QueryHit{ ent, intersection->fraction, origin + delta * intersection->fraction, intersection->normal };
+				}
+			}
+		};
+		testShape(CollidableAdapter(transform.position, collider.size, collider.form, transform.rotaVec));
+		for (auto& extra : collider.extraColliders()) {
+			testShape(CollidableAdapter(transform.position + rotate(extra.relativePos, transform.rotaVec), extra.size, extra.form, transform.rotaVec * extra.relativeRota));
+		}
+	}
+	return hit;
 }
 
-void CollisionSystem::prepare(CollisionSECM secm)
+std::optional<QueryHit> CollisionSystem::shapeCast(Transform const& start, Collider const& collider, Vec2 translation, uint8_t colliderCategories) const
 {
-	cleanBuffers(secm);
+	const Vec2 aabb = colliderAABB(start, collider);
+	FrameVector<EntityHandleIndex> near;
+	collectOverlappingAABBs(near, start.position + translation * 0.5f, aabb + abs(translation), colliderCategories);
 
-	JobSystem::Tag clearCollTokensJobTag = JobSystem::submit(
-		LambdaJob{
-			[&](u32 thread) {
-				clearCollisionTokens();
+	const float castLength = length(translation);
+	FrameVector<CollPoint> collPoints;
+	Transform moved = start;
+	auto testAt = [&](EntityHandleIndex ent, float fraction) {
+		moved.position = start.position + translation * fraction;
+		return testCollider(moved, collider, ent, collPoints);
+	};
+
+	// a rotated collider can be much thinner than its aabb, so the steps are based on the sizes of the shapes:
+	auto minExtent = [](Collider const& c) {
+		float extent = std::min(c.size.x, c.size.y);
+		for (auto& extra : c.extraColliders()) {
+			extent = std::min({ extent, extra.size.x, extra.size.y });
+		}
+		return extent;
+	};
+	const float castExtent = minExtent(collider);
+
+	std::optional<QueryHit> hit;
+	for (auto ent : near) {
+		// the colliders can only touch while the aabbs overlap, that is while the cast position is inside the aabb of ent expanded by the cast aabb.
+		// The slab test gives the fractions where the cast enters and leaves the expanded aabb, only this interval is sampled:
+		const Vec2 otherAABB = aabbCache[ent];
+		const Vec2 otherPosition = secm.getComp<Transform>(ent).position;
+		const Vec2 halfSize = (aabb + otherAABB) * 0.5f;
+		float enter = 0.0f;
+		float exit = hit ? hit->fraction : 1.0f;
+		for (u32 axis = 0; axis < 2; ++axis) {
+			const float low = otherPosition[axis] - halfSize[axis] - start.position[axis];
+			const float high = otherPosition[axis] + halfSize[axis] - start.position[axis];
+			if (translation[axis] == 0.0f) {
+				if (low > 0.0f || high < 0.0f) exit = -1.0f;
+			}
+			else {
+				const float t0 = low / translation[axis];
+				const float t1 = high / translation[axis];
+				enter = std::max(enter, std::min(t0, t1));
+				exit = std::min(exit, std::max(t0, t1));
 			}
 		}
-	);
+		if (enter > exit) continue;
 
-	Vec2 minPos{ 0,0 }, maxPos{ 0,0 };
-	for (auto colliderEnt : secm.entityView<Collider>()) {
-		auto colliderID = colliderEnt.index;
-		auto& collider = secm.getComp<Collider>(colliderID);
-		auto& baseCollider = secm.getComp<Transform>(colliderID);
-		minPos = min(minPos, baseCollider.position);
-		maxPos = max(maxPos, baseCollider.position);
-
-		if (secm.hasComp<PhysicsBody>(colliderID)) { // if a collider has a solidBody, it is a physics object
-			if (secm.hasComp<Movement>(colliderID)) {	// is it dynamic or static?
-				if (collider.particle) {
-					particleEntities.push_back(colliderID);
+		// steps of half the smaller extent of both colliders can not step over the other collider, only a path that grazes a corner can be missed.
+		// The steps are capped, so a collider more than MAX_SHAPE_CAST_STEPS / 2 times thinner than the interval is long can be tunneled,
+		// the interval is at most as long as the diagonal of the expanded aabb, independent of the cast length:
+		const float intervalLength = (exit - enter) * castLength;
+		const float stepLength = std::max(std::min(castExtent, minExtent(secm.getComp<Collider>(ent))) * 0.5f, intervalLength / MAX_SHAPE_CAST_STEPS);
+		const size_t steps = intervalLength > 0.0f ? size_t(std::ceil(intervalLength / stepLength)) : 0;
+
+		float before = enter;
+		std::optional<float> contact;
+		if (testAt(ent, enter)) {
+			contact = enter;
+		}
+		for (size_t step = 1; step <= steps && !contact; ++step) {
+			const float fraction = std::min(exit, enter + float(step) * stepLength / castLength);
+			if (testAt(ent, fraction)) {
+				contact = fraction;
+			}
+			else {
+				before = fraction;
+			}
+		}
+		if (!contact) continue;
+
+		// the contact lies between the last free sample and the first overlapping one, there is no contact before the interval:
+		float after = *contact;
+		if (after > enter) {
+			for (size_t i = 0; i < SHAPE_CAST_BISECTIONS; ++i) {
+				const float middle = (before + after) * 0.5f;
+				if (testAt(ent, middle)) {
+					after = middle;
 				}
 				else {
-					dynamicSolidEntities.push_back(colliderID);
+					before = middle;
 				}
 			}
-			else {	// entity must be static
-				staticSolidEntities.push_back(colliderID);
-			}
 		}
-		else { // if a collider has NO PhysicsBody, it is a sensor
-			sensorEntities.push_back(colliderID);
+		if (!hit || after < hit->fraction) {
+			const auto info = testAt(ent, after);
+			hit = QueryHit{ ent, after, moved.position, info->normal[0] };
 		}
 	}
+	return hit;
+}
 
-	JobSystem::wait(JobSystem::submitVec(
-		std::vector<CacheAABBJob>{
-		CacheAABBJob(particleEntities, secm, aabbCache),
-			CacheAABBJob(dynamicSolidEntities, secm, aabbCache),
-			CacheAABBJob(staticSolidEntities, secm, aabbCache),
-			CacheAABBJob(sensorEntities, secm, aabbCache)
+void CollisionSystem::querryAABBBatch(std::vector<AABBQuery> const& querries, std::vector<std::vector<EntityHandleIndex>>& results, uint8_t colliderCategories) const
+{
+	if (results.size() < querries.size()) {
+		results.resize(querries.size());
 	}
-	));
+	JobSystem::parallelFor(querries.size(), MIN_QUERRIES_PER_CHUNK,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				results[i].clear();
+				querryAABB(results[i], querries[i].position, querries[i].size, colliderCategories);
+			}
+		}
+	);
+}
 
-	/* rebuild qtrees: */
+void CollisionSystem::raycastBatch(std::vector<RayQuery> const& rays, std::vector<std::optional<QueryHit>>& hits, uint8_t colliderCategories) const
+{
+	hits.resize(rays.size());
+	JobSystem::parallelFor(rays.size(), MIN_QUERRIES_PER_CHUNK,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				hits[i] = raycast(rays[i].origin, rays[i].end, colliderCategories);
+			}
+		}
+	);
+}
+
+inline size_t CollisionSystem::collisionCount() const
+{
+	return collisions.size();
+}
+
+void CollisionSystem::prepare(CollisionSECM secm)
+{
+	cleanBuffers(secm);
 
-	qtreeDynamic.resetPerMinMax(minPos, maxPos);
-	qtreeDynamic.removeEmptyLeafes();
+	JobSystem::Tag addCollTokensJobTag = JobSystem::submit(
+		LambdaJob{
+			[&](u32 thread) {
+				addMissingCollisionTokens();
+			}
+		}
+	);
 
-	if (colliderDetectionEnableFlags & qtreeDynamic.COLLIDER_TAG) {
-		qtreeDynamic.broadInsert(dynamicSolidEntities, aabbCache);
+	// classify the colliders, cache their aabbs and reduce the bounds in one parallel pass over the entity indices:
+	const size_t entityCount = secm.maxEntityIndex();
+	const size_t chunks = JobSystem::chunkCount(entityCount, MIN_ENTITIES_PER_PREPARE_CHUNK);
+	if (prepareChunks.size() < chunks) {
+		prepareChunks.resize(chunks);
 	}
+	JobSystem::parallelForChunks(entityCount, chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			PrepareChunk& data = prepareChunks[chunk];
+			data.sensors.clear();
+			data.particles.clear();
+			data.dynamics.clear();
+			data.sleeping.clear();
+			data.statics.clear();
+			Vec2 minPos{ 0,0 }, maxPos{ 0,0 };
+			for (EntityHandleIndex colliderID = EntityHandleIndex(begin); colliderID < end; ++colliderID) {
+				if (!secm.hasComp<Collider>(colliderID) || !secm.isSpawned(colliderID)) continue;
+				auto& collider = secm.getComp<Collider>(colliderID);
+				auto& baseCollider = secm.getComp<Transform>(colliderID);
+				minPos = min(minPos, baseCollider.position);
+				maxPos = max(maxPos, baseCollider.position);
+				aabbCache[colliderID] = colliderAABB(baseCollider, collider);
 
-	qtreeStatic.resetPerMinMax(minPos, maxPos);
-	qtreeStatic.removeEmptyLeafes();
+				if (secm.hasComp<PhysicsBody>(colliderID)) { // if a collider has a solidBody, it is a physics object
+					if (secm.hasComp<Movement>(colliderID)) {	// is it dynamic or static?
+						if (collider.particle) {
+							data.particles.push_back(colliderID);
+							categoryCache[colliderID] = Collider::PARTICLE;
+						}
+						else {
+							if (secm.getComp<Movement>(colliderID).sleeping) {
+								data.sleeping.push_back(colliderID);
+							}
+							else {
+								data.dynamics.push_back(colliderID);
+							}
+							categoryCache[colliderID] = Collider::DYNAMIC;
+						}
+					}
+					else {	// entity must be static
+						data.statics.push_back(colliderID);
+						categoryCache[colliderID] = Collider::STATIC;
+					}
+				}
+				else { // if a collider has NO PhysicsBody, it is a sensor
+					data.sensors.push_back(colliderID);
+					categoryCache[colliderID] = Collider::SENSOR;
+				}
+			}
+			data.minPos = minPos;
+			data.maxPos = maxPos;
+		}
+	);
 
-	if (colliderDetectionEnableFlags & qtreeStatic.COLLIDER_TAG) {
-		qtreeStatic.broadInsert(staticSolidEntities, aabbCache);
+	// the chunks are merged in order, so the category lists stay sorted by entity:
+	Vec2 minPos{ 0,0 }, maxPos{ 0,0 };
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		const PrepareChunk& data = prepareChunks[chunk];
+		sensorEntities.insert(sensorEntities.end(), data.sensors.begin(), data.sensors.end());
+		particleEntities.insert(particleEntities.end(), data.particles.begin(), data.particles.end());
+		dynamicSolidEntities.insert(dynamicSolidEntities.end(), data.dynamics.begin(), data.dynamics.end());
+		sleepingEntities.insert(sleepingEntities.end(), data.sleeping.begin(), data.sleeping.end());
+		staticSolidEntities.insert(staticSolidEntities.end(), data.statics.begin(), data.statics.end());
+		minPos = min(minPos, data.minPos);
+		maxPos = max(maxPos, data.maxPos);
+	}
+
+	// the statics are tracked in every mode, so the static sdf is only baked again when they change:
+	const bool staticsChanged = haveStaticsChanged();
+	if (staticsChanged) {
+		takeStaticSnapshot();
+	}
+	if (staticSDF && (staticsChanged || staticSDFDirty)) {
+		staticSDF->bake(secm, staticSolidEntities, aabbCache);
+		staticSDFDirty = false;
 	}
+	markSDFCircles();
 
-	qtreeParticle.resetPerMinMax(minPos, maxPos);
-	qtreeParticle.removeEmptyLeafes();
+	if (detectionMode == CollisionDetectionMode::SweepAndPrune) {
+		auto addToSweepAndPrune = [&](std::vector<EntityHandleIndex> const& entities, uint8_t colliderTag) {
+			sweepAndPrune.addEntities(entities, colliderTag, querriedCategories(colliderTag), colliderDetectionEnableFlags & colliderTag);
+		};
+		addToSweepAndPrune(dynamicSolidEntities, Collider::DYNAMIC);
+		// sleeping dynamics can be found, but querry nothing:
+		sweepAndPrune.addEntities(sleepingEntities, Collider::DYNAMIC, 0, colliderDetectionEnableFlags & Collider::DYNAMIC);
+		addToSweepAndPrune(staticSolidEntities, Collider::STATIC);
+		addToSweepAndPrune(particleEntities, Collider::PARTICLE);
+		addToSweepAndPrune(sensorEntities, Collider::SENSOR);
+		sweepAndPrune.update(aabbCache);
 
-	if (colliderDetectionEnableFlags & qtreeParticle.COLLIDER_TAG) {
-		qtreeParticle.broadInsert(particleEntities, aabbCache);
+		// the broadphases are not kept up to date, so the static broadphase is rebuilt when switching back:
+		rebuildStatic = true;
+		rebuildSleeping = true;
+
+		JobSystem::wait(addCollTokensJobTag);
+		return;
 	}
 
-	qtreeSensor.resetPerMinMax(minPos, maxPos);
-	qtreeSensor.removeEmptyLeafes();
+	/* update broadphases: */
 
-	if (colliderDetectionEnableFlags & qtreeSensor.COLLIDER_TAG) {
-		qtreeSensor.broadInsert(sensorEntities, aabbCache);
+	const std::vector<EntityHandleIndex> noEntities;
+	auto updateBroadphase = [&](Broadphase& broadphase, std::vector<EntityHandleIndex> const& entities) {
+		if (colliderDetectionEnableFlags & broadphase.COLLIDER_TAG) {
+			broadphase.update(entities, aabbCache, minPos, maxPos);
+		}
+		else {
+			broadphase.update(noEntities, aabbCache, minPos, maxPos);
+		}
+	};
+	updateBroadphase(*dynamicBroadphase, dynamicSolidEntities);
+	// sleeping dynamics do not move, their broadphase is only updated when one falls asleep, wakes up or is moved:
+	if (rebuildSleeping || differsFromSnapshot(sleepingEntities, sleepingSnapshot)) {
+		updateBroadphase(*sleepingBroadphase, sleepingEntities);
+		sleepingSnapshot.clear();
+		for (const auto ent : sleepingEntities) {
+			sleepingSnapshot.push_back(StaticColliderState{ ent, secm.getComp<Transform>(ent).position, secm.getComp<Transform>(ent).rotaVec, aabbCache[ent] });
+		}
+		sleepingRebuildCount += 1;
+		rebuildSleeping = false;
+	}
+	if (staticsChanged || rebuildStatic) {
+		updateBroadphase(*staticBroadphase, staticSolidEntities);
+		staticRebuildCount += 1;
+		rebuildStatic = false;
 	}
+	updateBroadphase(*particleBroadphase, particleEntities);
+	updateBroadphase(*sensorBroadphase, sensorEntities);
 
-	JobSystem::wait(clearCollTokensJobTag);
+	JobSystem::wait(addCollTokensJobTag);
 }
 
 void CollisionSystem::cleanBuffers(CollisionSECM secm)
@@ -155,17 +519,27 @@ void CollisionSystem::cleanBuffers(CollisionSECM secm)
 	particleEntities.clear();
 	sensorEntities.clear();
 	dynamicSolidEntities.clear();
+	sleepingEntities.clear();
 	staticSolidEntities.clear();
-	aabbCache.clear();
 	if (aabbCache.size() < secm.maxEntityIndex()) {
 		aabbCache.resize(secm.maxEntityIndex());
 	}
+	if (categoryCache.size() < secm.maxEntityIndex()) {
+		categoryCache.resize(secm.maxEntityIndex(), 0);
+	}
 	for (auto& collisionList : collisionLists) {
 		collisionList.clear();
 	}
 	for (auto& jobBuffer : jobEntityBuffers) {
 		jobBuffer->clear();
 	}
+	triggerCandidates.clear();
+	for (auto& candidates : workerTriggerCandidates) {
+		candidates.clear();
+	}
+	for (auto& stats : workerMaskStats) {
+		stats = {};
+	}
 }
 
 void CollisionSystem::collisionDetection(CollisionSECM secm)
@@ -174,32 +548,46 @@ void CollisionSystem::collisionDetection(CollisionSECM secm)
 	public:
 
 		CollJob(
+			CollisionSystem const* system,
 			CollisionSECM subecm,
-			StaticVector<Quadtree const*, 4> qtrees,
+			StaticVector<Broadphase const*, 5> broadphases,
 			std::vector<Vec2> const* aabbCache,
-			std::vector<std::vector<CollisionInfo>>* collInfos)
+			std::vector<std::vector<CollisionInfo>>* collInfos,
+			std::vector<GroupMaskCullingStats>* maskStats,
+			bool maskCulling)
 			:
+			system{ system },
 			subecm{ subecm },
-			qtrees{ qtrees },
+			broadphases{ broadphases },
 			aabbCache{ aabbCache },
-			collInfos{ collInfos }
+			collInfos{ collInfos },
+			maskStats{ maskStats },
+			maskCulling{ maskCulling }
 		{}
 
 		void execute(const uint32_t thread) override
 		{
-			auto checkForCollisions = [&](EntityHandleIndex ent, Quadtree const& qtree) {
+			// buffers for queriing, allocated from the workers frame arena:
+			FrameArena& arena = JobSystem::frameArena(thread);
+			FrameVector<EntityHandleIndex> nearEntitiesBuffer{ FrameAllocator<EntityHandleIndex>(arena) };
+			FrameVector<CollPoint> collPoints{ FrameAllocator<CollPoint>(arena) };
+			BroadphaseQuerryStats querryStats;
+			size_t rejectedCandidates{ 0 };
+
+			auto checkForCollisions = [&](EntityHandleIndex ent, Broadphase const& broadphase) {
 				const auto& baseColl = subecm.getComp<Transform>(ent);
 				const auto& colliderColl = subecm.getComp<Collider>(ent);
 
 				nearEntitiesBuffer.clear();
-				qtreeQuerryBuffer.clear();
 				collPoints.clear();
 
-				//if (!colliderColl.sleeping) {
-					qtree.querry(nearEntitiesBuffer, qtreeQuerryBuffer, baseColl.position, aabbCache->at(ent));
+				broadphase.querry(nearEntitiesBuffer, baseColl.position, aabbCache->at(ent), maskCulling ? colliderColl.ignoreGroupMask : 0, querryStats);
+				// circles tested against the static sdf get no collision infos from the statics:
+				if (!system->sdfCircleCache.empty() && system->categoryCache[ent] == Collider::STATIC) {
+					std::erase_if(nearEntitiesBuffer, [&](EntityHandleIndex other) { return system->isSDFCircle(other); });
+				}
 
-					generateCollisionInfos2(subecm, collInfos->at(thread), *aabbCache, nearEntitiesBuffer, ent, baseColl, colliderColl, aabbCache->at(ent), collPoints);
-				//}
+				rejectedCandidates += generateCollisionInfos2(subecm, collInfos->at(thread), *aabbCache, nearEntitiesBuffer, ent, baseColl, colliderColl, aabbCache->at(ent), collPoints);
 			};
 
 			for (int i = 0; i < entities.size(); ++i) {
@@ -207,45 +595,52 @@ void CollisionSystem::collisionDetection(CollisionSECM secm)
 
 				Collider const& entColliderComp = subecm.getComp<Collider>(ent);
 
-				for (int j = 0; j < qtrees.size(); ++j) {
-					Quadtree const* qtree = qtrees[j];
+				for (int j = 0; j < broadphases.size(); ++j) {
+					Broadphase const* broadphase = broadphases[j];
 
-					if (!entColliderComp.isIgnoring(qtree->COLLIDER_TAG)) {
-						checkForCollisions(ent, *qtree);
+					if (entColliderComp.isIgnoring(broadphase->COLLIDER_TAG)) continue;
+
+					if (broadphase->COLLIDER_TAG == Collider::STATIC && system->isSDFCircle(ent)) {
+						if (auto info = system->sdfCollision(ent)) {
+							collInfos->at(thread).push_back(*info);
+						}
+					}
+					else {
+						checkForCollisions(ent, *broadphase);
 					}
 				}
 			}
+
+			auto& stats = maskStats->at(thread);
+			stats.culledNodes += querryStats.culledNodes;
+			stats.culledEntities += querryStats.culledEntities;
+			stats.rejectedCandidates += rejectedCandidates;
 		}
 
 		StaticVector<EntityHandleIndex, MAX_ENTITIES_PER_JOB> entities;
 	private:
+		CollisionSystem const* system;
 		std::vector<std::vector<CollisionInfo>>* collInfos;
-		StaticVector<Quadtree const*, 4> qtrees;
+		StaticVector<Broadphase const*, 5> broadphases;
 		CollisionSECM subecm;
 		std::vector<Vec2> const* aabbCache;
-
-		// buffers for queriing:
-		std::vector<EntityHandleIndex> nearEntitiesBuffer;
-		std::vector<QtreeNodeQuerry> qtreeQuerryBuffer;
-		std::vector<CollPoint> collPoints;
+		std::vector<GroupMaskCullingStats>* maskStats;
+		bool maskCulling;
 	};
 
 	std::vector<CollJob> jobs;
 	jobs.reserve(200);
 
-	auto createCollisionCheckJobs = [&](const std::vector<EntityHandleIndex>& entities, const uint8_t qtreeMask) {
-
-		StaticVector<Quadtree const*, 4> qtrees;
-		if (qtreeDynamic.COLLIDER_TAG & qtreeMask) { qtrees.push_back(&qtreeDynamic); }
-		if (qtreeStatic.COLLIDER_TAG & qtreeMask) { qtrees.push_back(&qtreeStatic); }
-		if (qtreeParticle.COLLIDER_TAG & qtreeMask) { qtrees.push_back(&qtreeParticle); }
-		if (qtreeSensor.COLLIDER_TAG & qtreeMask) { qtrees.push_back(&qtreeSensor); }
+	auto createCollisionCheckJobs = [&](const std::vector<EntityHandleIndex>& entities, const uint8_t colliderTag) {
 
 		const auto newCollJob = CollJob(
+			this,
 			secm,
-			qtrees,
+			querriedBroadphases(colliderTag),
 			&aabbCache,
-			&collisionLists
+			&collisionLists,
+			&workerMaskStats,
+			broadphaseMaskCulling
 		);
 
 		auto c = newCollJob;
@@ -265,50 +660,551 @@ void CollisionSystem::collisionDetection(CollisionSECM secm)
 		}
 	};
 
-	createCollisionCheckJobs(particleEntities, Collider::DYNAMIC | Collider::STATIC);
+	createCollisionCheckJobs(particleEntities, Collider::PARTICLE);
 
-	createCollisionCheckJobs(dynamicSolidEntities, Collider::DYNAMIC | Collider::STATIC);
+	// sleeping dynamics do not querry, they get their collisions with awake colliders from the querries of the awake ones:
+	createCollisionCheckJobs(dynamicSolidEntities, Collider::DYNAMIC);
 
-	createCollisionCheckJobs(staticSolidEntities, Collider::DYNAMIC);
+	createCollisionCheckJobs(staticSolidEntities, Collider::STATIC);
 
-	createCollisionCheckJobs(sensorEntities, Collider::PARTICLE | Collider::DYNAMIC | Collider::SENSOR | Collider::STATIC);
+	if (!sensorTriggers) {
+		createCollisionCheckJobs(sensorEntities, Collider::SENSOR);
+	}
 
 	auto tag = JobSystem::submitVec(std::move(jobs));
 
 	JobSystem::wait(tag);
+}
+
+void CollisionSystem::findPairsFromQuerries(CollisionSECM secm)
+{
+	for (auto& list : workerPairs) {
+		list.clear();
+	}
+
+	auto querryPairs = [&](const std::vector<EntityHandleIndex>& entities, const uint8_t colliderTag) {
+		const StaticVector<Broadphase const*, 5> broadphases = querriedBroadphases(colliderTag);
 
-	// reset quadtree rebuild flags
-	rebuildStatic = false;
-
-	for (u32 wi = 0; wi < collisionLists.size(); wi++) {
-		auto& workerCollInfos = collisionLists[wi];
-		if (workerCollInfos.size() > 0) {
-			EntityHandleIndex currentEntity = workerCollInfos[0].indexA;
-			secm.getComp<CollisionsToken>(currentEntity).begin = 0;
-			secm.getComp<CollisionsToken>(currentEntity).workerIndex = wi;
-			for (int i = 1; i < workerCollInfos.size(); i++) {
-				if (currentEntity != workerCollInfos[i].indexA) {	//new idA found
-					auto nextEntity = workerCollInfos[i].indexA;
-					secm.getComp<CollisionsToken>(nextEntity).begin = i;
-					secm.getComp<CollisionsToken>(nextEntity).workerIndex = wi;
-					secm.getComp<CollisionsToken>(currentEntity).end = i;
-					currentEntity = nextEntity;	//set lastId to new id
+		JobSystem::parallelFor(entities.size(), MAX_ENTITIES_PER_JOB,
+			[&](size_t begin, size_t end, uint32_t threadId) {
+				FrameVector<EntityHandleIndex> near{ FrameAllocator<EntityHandleIndex>(JobSystem::frameArena(threadId)) };
+				auto& out = workerPairs[threadId];
+				BroadphaseQuerryStats querryStats;
+				size_t rejectedCandidates{ 0 };
+				for (size_t i = begin; i < end; ++i) {
+					const EntityHandleIndex ent = entities[i];
+					const Vec2 pos = secm.getComp<Transform>(ent).position;
+					const Collider& collider = secm.getComp<Collider>(ent);
+					const CollisionMask cullMask = broadphaseMaskCulling ? collider.ignoreGroupMask : 0;
+					near.clear();
+					for (int j = 0; j < broadphases.size(); ++j) {
+						if (collider.isIgnoring(broadphases[j]->COLLIDER_TAG)) continue;
+						// the pairs of static sdf circles with statics are dropped in the narrowphase anyway:
+						if (broadphases[j]->COLLIDER_TAG == Collider::STATIC && isSDFCircle(ent)) continue;
+						broadphases[j]->querry(near, pos, aabbCache[ent], cullMask, querryStats);
+					}
+					for (const auto other : near) {
+						// a pair ignored by this side is still found from the other side, if the other side wants it:
+						if (collider.ignoreGroupMask & secm.getComp<Collider>(other).groupMask) {
+							rejectedCandidates += 1;
+						}
+						else if (other != ent && isOverlappingAABB(pos, aabbCache[ent], secm.getComp<Transform>(other).position, aabbCache[other])) {
+							out.push_back(ent < other ? EntityPair{ ent, other } : EntityPair{ other, ent });
+						}
+					}
+				}
+				auto& stats = workerMaskStats[threadId];
+				stats.culledNodes += querryStats.culledNodes;
+				stats.culledEntities += querryStats.culledEntities;
+				stats.rejectedCandidates += rejectedCandidates;
+			}
+		);
+	};
+	querryPairs(particleEntities, Collider::PARTICLE);
+	querryPairs(dynamicSolidEntities, Collider::DYNAMIC);
+	querryPairs(staticSolidEntities, Collider::STATIC);
+	if (!sensorTriggers) {
+		querryPairs(sensorEntities, Collider::SENSOR);
+	}
+
+	// most pairs are found from both sides, sorting makes the duplicates adjacent and the order independent of the thread timing:
+	pairs.clear();
+	for (const auto& list : workerPairs) {
+		pairs.insert(pairs.end(), list.begin(), list.end());
+	}
+	auto pairLess = [](const EntityPair& a, const EntityPair& b) {
+		return a.a < b.a || (a.a == b.a && a.b < b.b);
+	};
+	auto pairEqual = [](const EntityPair& a, const EntityPair& b) {
+		return a.a == b.a && a.b == b.b;
+	};
+	std::sort(pairs.begin(), pairs.end(), pairLess);
+	pairs.erase(std::unique(pairs.begin(), pairs.end(), pairEqual), pairs.end());
+}
+
+void CollisionSystem::pairCollisionDetection(CollisionSECM secm)
+{
+	// every pair is tested once, both entities get the collision info if they want it:
+	const size_t chunks = JobSystem::chunkCount(pairs.size(), MIN_PAIRS_PER_CHUNK);
+	if (pairChunks.size() < chunks) {
+		pairChunks.resize(chunks);
+	}
+	JobSystem::parallelForChunks(pairs.size(), chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			FrameVector<CollPoint> collPoints{ FrameAllocator<CollPoint>(JobSystem::frameArena(threadId)) };
+			PairChunk& data = pairChunks[chunk];
+			data.infos.clear();
+			data.circleCircle.clear();
+			data.circleRectangle.clear();
+			data.rectangleRectangle.clear();
+			data.compound.clear();
+			data.stats = {};
+
+			// the id of a pair is its index in pairs shifted by 3, 
+			// bit 0 and 1 tell if a and b want the collision info, bit 2 is set if a and b are swapped in the batch:
+			auto pushInfos = [&](uint32_t id, CollisionInfo const& info, NarrowphaseBucketStats& stats) {
+				if (id & 1) data.infos.push_back(info);
+				if (id & 2) data.infos.push_back(mirrorCollisionInfo(info));
+				stats.collisions += 1;
+			};
+
+			// sort the candidates into the shape pair buckets:
+			for (size_t i = begin; i < end; ++i) {
+				const auto [a, b] = pairs[i];
+				const bool aWants = wantsCollisionInfo(a, b);
+				const bool bWants = wantsCollisionInfo(b, a);
+				if (!aWants && !bWants) continue;
+				if (isSDFPair(a, b)) continue;
+
+				const auto& baseA = secm.getComp<Transform>(a);
+				const auto& baseB = secm.getComp<Transform>(b);
+				if (!isOverlappingAABB(baseA.position, aabbCache[a], baseB.position, aabbCache[b])) continue;
+
+				const auto& colliderA = secm.getComp<Collider>(a);
+				const auto& colliderB = secm.getComp<Collider>(b);
+				const uint32_t id = (uint32_t(i) << 3) | uint32_t(aWants) | (uint32_t(bWants) << 1);
+				if (colliderA.hasExtraColliders() || colliderB.hasExtraColliders()) {
+					data.compound.push_back(id);
+				}
+				else if (colliderA.form == Form::Circle && colliderB.form == Form::Circle) {
+					data.circleCircle.push(id, baseA.position, colliderA.size, baseA.rotaVec, baseB.position, colliderB.size, baseB.rotaVec);
+				}
+				else if (colliderA.form == Form::Circle) {
+					data.circleRectangle.push(id, baseA.position, colliderA.size, baseA.rotaVec, baseB.position, colliderB.size, baseB.rotaVec);
+				}
+				else if (colliderB.form == Form::Circle) {
+					data.circleRectangle.push(id | 4, baseB.position, colliderB.size, baseB.rotaVec, baseA.position, colliderA.size, baseA.rotaVec);
+				}
+				else {
+					data.rectangleRectangle.push(id, baseA.position, colliderA.size, baseA.rotaVec, baseB.position, colliderB.size, baseB.rotaVec);
+				}
+			}
+
+			// every bucket is processed by its own loop. The batched overlap tests sort out most candidates, 
+			// only the overlapping ones get a collision manifold from the collision test of the bucket:
+			auto processBatch = [&](const ShapePairBatch& batch, ShapePairBucket bucket, auto overlapTest, Form formA, Form formB, auto collisionTest) {
+				NarrowphaseBucketStats& stats = data.stats[size_t(bucket)];
+				data.overlapping.resize(batch.size());
+				const size_t count = overlapTest(batch, data.overlapping.data(), BEST_SIMD_LEVEL);
+				stats.candidates = batch.size();
+				stats.overlapping = count;
+				for (size_t i = 0; i < count; ++i) {
+					const uint32_t index = data.overlapping[i];
+					const uint32_t id = batch.ids[index];
+					const CollidableAdapter shapeA(Vec2{ batch.aPosX[index], batch.aPosY[index] }, Vec2{ batch.aSizeX[index], batch.aSizeY[index] }, formA, RotaVec2{ batch.aSin[index], batch.aCos[index] });
+					const CollidableAdapter shapeB(Vec2{ batch.bPosX[index], batch.bPosY[index] }, Vec2{ batch.bSizeX[index], batch.bSizeY[index] }, formB, RotaVec2{ batch.bSin[index], batch.bCos[index] });
+					const CollisionTestResult result = collisionTest(shapeA, shapeB, (id & 4) != 0);
+					if (result.collisionCount > 0) {
+						const auto [a, b] = pairs[id >> 3];
+						pushInfos(id, CollisionInfo(a, b, result.clippingDist, result.collisionNormal, result.collisionNormal, result.collisionPos, result.collisionPos2, result.collisionCount, result.feature, result.feature2), stats);
+					}
+				}
+			};
+			processBatch(data.circleCircle, ShapePairBucket::CircleCircle, batchOverlapCircleCircle, Form::Circle, Form::Circle,
+				[](CollidableAdapter const& a, CollidableAdapter const& b, bool swapped) { return circleCircleCollisionCheck(a, b); });
+			processBatch(data.circleRectangle, ShapePairBucket::CircleRectangle, batchOverlapCircleRectangle, Form::Circle, Form::Rectangle,
+				[](CollidableAdapter const& circle, CollidableAdapter const& rect, bool swapped) { return checkCircleRectangleCollision(circle, rect, !swapped); });
+			processBatch(data.rectangleRectangle, ShapePairBucket::RectangleRectangle, batchOverlapRectangleRectangle, Form::Rectangle, Form::Rectangle,
+				[](CollidableAdapter const& a, CollidableAdapter const& b, bool swapped) { return rectangleRectangleCollisionCheck2(a, b); });
+
+			// compound colliders are tested shape by shape:
+			NarrowphaseBucketStats& compoundStats = data.stats[size_t(ShapePairBucket::Compound)];
+			compoundStats.candidates = data.compound.size();
+			compoundStats.overlapping = data.compound.size();
+			for (const uint32_t id : data.compound) {
+				const auto [a, b] = pairs[id >> 3];
+				if (auto info = generateCollisionInfo(a, secm.getComp<Transform>(a), secm.getComp<Collider>(a), b, secm.getComp<Transform>(b), secm.getComp<Collider>(b), collPoints)) {
+					pushInfos(id, *info, compoundStats);
 				}
 			}
-			secm.getComp<CollisionsToken>(currentEntity).end = uint32_t(workerCollInfos.size());
 		}
+	);
+
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		for (size_t bucket = 0; bucket < narrowphaseStats.size(); ++bucket) {
+			narrowphaseStats[bucket].candidates += pairChunks[chunk].stats[bucket].candidates;
+			narrowphaseStats[bucket].overlapping += pairChunks[chunk].stats[bucket].overlapping;
+			narrowphaseStats[bucket].collisions += pairChunks[chunk].stats[bucket].collisions;
+		}
+	}
+
+	// the collision infos of an entity must be contiguous:
+	auto& collInfos = collisionLists[0];
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		collInfos.insert(collInfos.end(), pairChunks[chunk].infos.begin(), pairChunks[chunk].infos.end());
 	}
+	if (!sdfCircleCache.empty()) {
+		for (auto& infos : workerSDFInfos) {
+			infos.clear();
+		}
+		auto collectSDFCollisions = [&](const std::vector<EntityHandleIndex>& entities) {
+			JobSystem::parallelFor(entities.size(), MIN_PAIRS_PER_CHUNK,
+				[&](size_t begin, size_t end, uint32_t threadId) {
+					for (size_t i = begin; i < end; ++i) {
+						if (!isSDFCircle(entities[i])) continue;
+						if (auto info = sdfCollision(entities[i])) {
+							workerSDFInfos[threadId].push_back(*info);
+						}
+					}
+				}
+			);
+		};
+		collectSDFCollisions(dynamicSolidEntities);
+		collectSDFCollisions(particleEntities);
+		for (const auto& infos : workerSDFInfos) {
+			collInfos.insert(collInfos.end(), infos.begin(), infos.end());
+		}
+	}
+	std::sort(collInfos.begin(), collInfos.end(),
+		[](const CollisionInfo& a, const CollisionInfo& b) {
+			return a.indexA < b.indexA || (a.indexA == b.indexA && a.indexB < b.indexB);
+		}
+	);
 }
 
-void CollisionSystem::clearCollisionTokens()
+void CollisionSystem::querrySensorCandidates(CollisionSECM secm)
 {
-	for (EntityHandle entity : secm.entityView<Collider>()) {
-		if (auto* token = secm.getIf<CollisionsToken>(entity.index)) {
-			token->begin = 0;
-			token->end = 0;
-			token->workerIndex = -1;
+	const StaticVector<Broadphase const*, 5> broadphases = querriedBroadphases(Collider::SENSOR);
+
+	JobSystem::parallelFor(sensorEntities.size(), MAX_ENTITIES_PER_JOB,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			FrameVector<EntityHandleIndex> near{ FrameAllocator<EntityHandleIndex>(JobSystem::frameArena(threadId)) };
+			auto& out = workerTriggerCandidates[threadId];
+			BroadphaseQuerryStats querryStats;
+			for (size_t i = begin; i < end; ++i) {
+				const EntityHandleIndex sensor = sensorEntities[i];
+				const Collider& collider = secm.getComp<Collider>(sensor);
+				near.clear();
+				for (int j = 0; j < broadphases.size(); ++j) {
+					if (!collider.isIgnoring(broadphases[j]->COLLIDER_TAG)) {
+						broadphases[j]->querry(near, secm.getComp<Transform>(sensor).position, aabbCache[sensor], broadphaseMaskCulling ? collider.ignoreGroupMask : 0, querryStats);
+					}
+				}
+				for (const auto other : near) {
+					if (other != sensor && wantsCollisionInfo(sensor, other)) {
+						out.push_back(triggerKey(sensor, other));
+					}
+				}
+			}
+			auto& stats = workerMaskStats[threadId];
+			stats.culledNodes += querryStats.culledNodes;
+			stats.culledEntities += querryStats.culledEntities;
+		}
+	);
+	for (const auto& candidates : workerTriggerCandidates) {
+		triggerCandidates.insert(triggerCandidates.end(), candidates.begin(), candidates.end());
+	}
+}
+
+void CollisionSystem::extractSensorPairs()
+{
+	// only sensors querry sensors, so the pairs with a sensor produce no collision infos for the other entity:
+	auto isSensorPair = [&](const EntityPair& pair) {
+		if (categoryCache[pair.a] != Collider::SENSOR && categoryCache[pair.b] != Collider::SENSOR) return false;
+		if (wantsCollisionInfo(pair.a, pair.b)) triggerCandidates.push_back(triggerKey(pair.a, pair.b));
+		if (wantsCollisionInfo(pair.b, pair.a)) triggerCandidates.push_back(triggerKey(pair.b, pair.a));
+		return true;
+	};
+	pairs.erase(std::remove_if(pairs.begin(), pairs.end(), isSensorPair), pairs.end());
+}
+
+void CollisionSystem::triggerDetection(CollisionSECM secm)
+{
+	// a sensor can find the same entity in multiple broadphase nodes:
+	JobSystem::parallelSort(triggerCandidates.begin(), triggerCandidates.end(), std::less<uint64_t>(), MIN_TRIGGER_CANDIDATES_PER_CHUNK);
+	triggerCandidates.erase(std::unique(triggerCandidates.begin(), triggerCandidates.end()), triggerCandidates.end());
+
+	triggerOverlaps.assign(triggerCandidates.size(), 0);
+	const size_t chunks = JobSystem::chunkCount(triggerCandidates.size(), MIN_TRIGGER_CANDIDATES_PER_CHUNK);
+	if (triggerChunks.size() < chunks) {
+		triggerChunks.resize(chunks);
+	}
+	JobSystem::parallelForChunks(triggerCandidates.size(), chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			FrameVector<CollPoint> collPoints{ FrameAllocator<CollPoint>(JobSystem::frameArena(threadId)) };
+			TriggerChunk& data = triggerChunks[chunk];
+			data.circleCircle.clear();
+			data.circleRectangle.clear();
+			data.rectangleRectangle.clear();
+
+			// the id of a candidate in the batches is its index in triggerCandidates:
+			for (size_t i = begin; i < end; ++i) {
+				const auto a = EntityHandleIndex(triggerCandidates[i] >> 32);
+				const auto b = EntityHandleIndex(triggerCandidates[i] & 0xFFFFFFFF);
+				const auto& baseA = secm.getComp<Transform>(a);
+				const auto& baseB = secm.getComp<Transform>(b);
+				if (!isOverlappingAABB(baseA.position, aabbCache[a], baseB.position, aabbCache[b])) continue;
+
+				const auto& colliderA = secm.getComp<Collider>(a);
+				const auto& colliderB = secm.getComp<Collider>(b);
+				const uint32_t id = uint32_t(i);
+				if (colliderA.hasExtraColliders() || colliderB.hasExtraColliders()) {
+					// compound colliders are tested shape by shape:
+					triggerOverlaps[i] = generateCollisionInfo(a, baseA, colliderA, b, baseB, colliderB, collPoints).has_value();
+				}
+				else if (colliderA.form == Form::Circle && colliderB.form == Form::Circle) {
+					data.circleCircle.push(id, baseA.position, colliderA.size, baseA.rotaVec, baseB.position, colliderB.size, baseB.rotaVec);
+				}
+				else if (colliderA.form == Form::Circle) {
+					data.circleRectangle.push(id, baseA.position, colliderA.size, baseA.rotaVec, baseB.position, colliderB.size, baseB.rotaVec);
+				}
+				else if (colliderB.form == Form::Circle) {
+					data.circleRectangle.push(id, baseB.position, colliderB.size, baseB.rotaVec, baseA.position, colliderA.size, baseA.rotaVec);
+				}
+				else {
+					data.rectangleRectangle.push(id, baseA.position, colliderA.size, baseA.rotaVec, baseB.position, colliderB.size, baseB.rotaVec);
+				}
+			}
+
+			auto markOverlapping = [&](const ShapePairBatch& batch, auto overlapTest) {
+				data.overlapping.resize(batch.size());
+				const size_t count = overlapTest(batch, data.overlapping.data(), BEST_SIMD_LEVEL);
+				for (size_t i = 0; i < count; ++i) {
+					triggerOverlaps[batch.ids[data.overlapping[i]]] = 1;
+				}
+			};
+			markOverlapping(data.circleCircle, batchOverlapCircleCircle);
+			markOverlapping(data.circleRectangle, batchOverlapCircleRectangle);
+			markOverlapping(data.rectangleRectangle, batchOverlapRectangleRectangle);
+		}
+	);
+
+	triggerPairs.clear();
+	for (size_t i = 0; i < triggerCandidates.size(); ++i) {
+		if (triggerOverlaps[i]) triggerPairs.push_back(triggerCandidates[i]);
+	}
+
+	// both pair lists are sorted, so one merge finds the entered, stayed and exited pairs in key order:
+	triggerEvents.clear();
+	auto pushEvent = [&](uint64_t key, TriggerEventType type) {
+		triggerEvents.push_back(TriggerEvent{ EntityHandleIndex(key >> 32), EntityHandleIndex(key & 0xFFFFFFFF), type });
+	};
+	size_t last = 0;
+	size_t current = 0;
+	while (last < lastTriggerPairs.size() || current < triggerPairs.size()) {
+		if (current == triggerPairs.size() || (last < lastTriggerPairs.size() && lastTriggerPairs[last] < triggerPairs[current])) {
+			pushEvent(lastTriggerPairs[last++], TriggerEventType::Exit);
+		}
+		else if (last == lastTriggerPairs.size() || triggerPairs[current] < lastTriggerPairs[last]) {
+			pushEvent(triggerPairs[current++], TriggerEventType::Enter);
 		}
 		else {
+			pushEvent(triggerPairs[current++], TriggerEventType::Stay);
+			last += 1;
+		}
+	}
+	std::swap(triggerPairs, lastTriggerPairs);
+}
+
+void CollisionSystem::markSDFCircles()
+{
+	if (!staticSDF || !(colliderDetectionEnableFlags & Collider::STATIC)) {
+		sdfCircleCache.clear();
+		return;
+	}
+	sdfCircleCache.assign(secm.maxEntityIndex(), 0);
+	const CollisionMask staticGroups = staticSDF->getGroupMaskUnion();
+	auto mark = [&](const std::vector<EntityHandleIndex>& entities) {
+		JobSystem::parallelFor(entities.size(), MIN_ENTITIES_PER_PREPARE_CHUNK,
+			[&](size_t begin, size_t end, uint32_t threadId) {
+				for (size_t i = begin; i < end; ++i) {
+					const Collider& collider = secm.getComp<Collider>(entities[i]);
+					sdfCircleCache[entities[i]] = uint8_t(
+						collider.form == Form::Circle &&
+						!collider.hasExtraColliders() &&
+						!collider.isIgnoring(Collider::STATIC) &&
+						!(collider.ignoreGroupMask & staticGroups) &&
+						staticSDF->coversRadius(collider.size.x * 0.5f)
+					);
+				}
+			}
+		);
+	};
+	mark(dynamicSolidEntities);
+	mark(particleEntities);
+}
+
+std::optional<CollisionInfo> CollisionSystem::sdfCollision(EntityHandleIndex circle) const
+{
+	const Vec2 pos = secm.getComp<Transform>(circle).position;
+	const float radius = secm.getComp<Collider>(circle).size.x * 0.5f;
+	const StaticSDF::Sample sample = staticSDF->sample(pos);
+	if (sample.distance >= radius || sample.nearest == INVALID_ENTITY_HANDLE_INDEX) {
+		return {};
+	}
+	// the gradient points away from the static, like the collision normal:
+	const Vec2 contact = pos - sample.gradient * sample.distance;
+	return CollisionInfo(circle, sample.nearest, radius - sample.distance, sample.gradient, sample.gradient, contact, contact, 1);
+}
+
+StaticVector<Broadphase const*, 5> CollisionSystem::querriedBroadphases(uint8_t colliderTag) const
+{
+	StaticVector<Broadphase const*, 5> broadphases;
+	for (Broadphase const* broadphase : { dynamicBroadphase.get(), staticBroadphase.get(), particleBroadphase.get(), sensorBroadphase.get() }) {
+		if (broadphase->COLLIDER_TAG & querriedCategories(colliderTag)) {
+			broadphases.push_back(broadphase);
+		}
+	}
+	if ((querriedCategories(colliderTag) & Collider::DYNAMIC) && colliderTag != Collider::STATIC) {
+		broadphases.push_back(sleepingBroadphase.get());
+	}
+	return broadphases;
+}
+
+uint8_t CollisionSystem::querriedCategories(uint8_t colliderTag)
+{
+	switch (colliderTag) {
+	case Collider::PARTICLE:
+	case Collider::DYNAMIC:
+		return Collider::DYNAMIC | Collider::STATIC;
+	case Collider::STATIC:
+		return Collider::DYNAMIC;
+	case Collider::SENSOR:
+		return Collider::PARTICLE | Collider::DYNAMIC | Collider::SENSOR | Collider::STATIC;
+	}
+	return 0;
+}
+
+bool CollisionSystem::wantsCollisionInfo(EntityHandleIndex a, EntityHandleIndex b) const
+{
+	const uint8_t categoryB = categoryCache[b];
+	const Collider& colliderA = secm.getComp<Collider>(a);
+	const Collider& colliderB = secm.getComp<Collider>(b);
+	return (querriedCategories(categoryCache[a]) & categoryB)
+		&& (colliderDetectionEnableFlags & categoryB)
+		&& !colliderA.isIgnoring(categoryB)
+		&& !colliderB.isIgnoredBy(categoryB)
+		&& !(colliderA.ignoreGroupMask & colliderB.groupMask);
+}
+
+void CollisionSystem::compactCollisions(CollisionSECM secm)
+{
+	const size_t entityCount = secm.maxEntityIndex();
+	collisionOffsets.assign(entityCount + 1, 0);
+	if (collisionRuns.size() < entityCount) {
+		collisionRuns.resize(entityCount);
+	}
+
+	// the infos of an entity are one run in one list, its count is written where the run starts:
+	for (uint32_t list = 0; list < collisionLists.size(); ++list) {
+		const auto& infos = collisionLists[list];
+		JobSystem::parallelFor(infos.size(), MIN_COLLISIONS_PER_CHUNK,
+			[&](size_t begin, size_t end, uint32_t threadId) {
+				for (size_t i = begin; i < end; ++i) {
+					const EntityHandleIndex entity = infos[i].indexA;
+					if (i > 0 && infos[i - 1].indexA == entity) continue;
+					size_t runEnd = i + 1;
+					while (runEnd < infos.size() && infos[runEnd].indexA == entity) ++runEnd;
+					collisionOffsets[entity] = uint32_t(runEnd - i);
+					collisionRuns[entity] = CollisionRun{ list, uint32_t(i) };
+				}
+			}
+		);
+	}
+
+	const uint32_t total = JobSystem::parallelExclusiveScan(collisionOffsets.begin(), collisionOffsets.end(), MIN_ENTITIES_PER_COMPACT_CHUNK, collisionOffsetChunkSums);
+	collisions.resize(total);
+
+	JobSystem::parallelFor(entityCount, MIN_ENTITIES_PER_COMPACT_CHUNK,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t entity = begin; entity < end; ++entity) {
+				const uint32_t first = collisionOffsets[entity];
+				const uint32_t last = collisionOffsets[entity + 1];
+				if (last > first) {
+					const auto& run = collisionRuns[entity];
+					const auto source = collisionLists[run.list].begin() + run.begin;
+					std::copy(source, source + (last - first), collisions.begin() + first);
+				}
+				if (secm.hasComp<CollisionsToken>(EntityHandleIndex(entity))) {
+					auto& token = secm.getComp<CollisionsToken>(EntityHandleIndex(entity));
+					token.begin = first;
+					token.end = last;
+				}
+			}
+		}
+	);
+}
+
+bool CollisionSystem::haveStaticsChanged()
+{
+	bool changed = false;
+
+	// an added or removed component only matters, if the entity was or now is a static collider:
+	auto isStatic = [&](EntityHandleIndex entity) {
+		return secm.hasComp<Collider>(entity) && secm.hasComp<PhysicsBody>(entity) && !secm.hasComp<Movement>(entity);
+	};
+	auto checkEvents = [&](EntityHandleIndex entity, ComponentEvent event) {
+		if (!changed) {
+			changed = (entity < isInStaticSnapshot.size() && isInStaticSnapshot[entity]) || isStatic(entity);
+		}
+	};
+	colliderEvents.drain(checkEvents);
+	physicsBodyEvents.drain(checkEvents);
+	movementEvents.drain(checkEvents);
+
+	// the set of statics is unchanged, but their transforms or colliders may have been modified in place:
+	return changed || differsFromSnapshot(staticSolidEntities, staticSnapshot);
+}
+
+bool CollisionSystem::differsFromSnapshot(const std::vector<EntityHandleIndex>& entities, const std::vector<StaticColliderState>& snapshot) const
+{
+	if (snapshot.size() != entities.size()) {
+		return true;
+	}
+	for (size_t i = 0; i < snapshot.size(); ++i) {
+		const StaticColliderState& state = snapshot[i];
+		const auto ent = entities[i];
+		const Transform& transform = secm.getComp<Transform>(ent);
+		if (state.entity != ent || 
+			state.position != transform.position || 
+			!(state.rotaVec == transform.rotaVec) || 
+			state.aabb != aabbCache[ent]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void CollisionSystem::takeStaticSnapshot()
+{
+	for (const auto& state : staticSnapshot) {
+		isInStaticSnapshot[state.entity] = false;
+	}
+	staticSnapshot.clear();
+	for (const auto ent : staticSolidEntities) {
+		const Transform& transform = secm.getComp<Transform>(ent);
+		staticSnapshot.push_back(StaticColliderState{ ent, transform.position, transform.rotaVec, aabbCache[ent] });
+		if (isInStaticSnapshot.size() <= ent) {
+			isInStaticSnapshot.resize(ent + 1, false);
+		}
+		isInStaticSnapshot[ent] = true;
+	}
+}
+
+void CollisionSystem::addMissingCollisionTokens()
+{
+	for (EntityHandle entity : secm.entityView<Collider>()) {
+		if (!secm.hasComp<CollisionsToken>(entity.index)) {
 			secm.addComp<CollisionsToken>(entity);
 		}
 	}
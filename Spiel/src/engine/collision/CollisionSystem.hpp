@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <array>
+#include <span>
 
 #include <boost/container/static_vector.hpp>
 #include <robin_hood.h>
@@ -10,9 +12,82 @@
 #include "../../engine/math/vector_math.hpp"
 #include "../collision/collision_detection.hpp"
 #include "QuadTree.hpp"
-#include "CacheAABBJob.hpp"
+#include "LinearQuadtree.hpp"
+#include "DynamicAABBTree.hpp"
+#include "GridBroadphase.hpp"
+#include "SweepAndPrune.hpp"
+#include "StaticSDF.hpp"
+#include "NarrowphaseKernels.hpp"
 #include "../../engine/types/StaticVector.hpp"
 
+/**
+ * The pair narrowphase sorts the candidate pairs into buckets of the same shape pair, so every bucket is processed by one specialized loop.
+ */
+enum class ShapePairBucket : uint8_t {
+	CircleCircle,
+	CircleRectangle,
+	RectangleRectangle,
+	Compound,			// at least one collider has extra colliders
+	Count
+};
+
+struct NarrowphaseBucketStats {
+	size_t candidates{ 0 };		// pairs with overlapping aabbs
+	size_t overlapping{ 0 };	// pairs that passed the batched overlap test
+	size_t collisions{ 0 };		// pairs that produced a collision
+};
+
+/**
+ * Entities whose groupMask intersects the ignoreGroupMask of a querying collider are rejected.
+ * With broadphase mask culling they are skipped inside of the broadphase, without it they are rejected after the querry.
+ */
+struct GroupMaskCullingStats {
+	size_t culledNodes{ 0 };			// broadphase nodes skipped as a whole
+	size_t culledEntities{ 0 };			// entities skipped one by one inside of the broadphases
+	size_t rejectedCandidates{ 0 };		// candidates returned by the broadphases and rejected afterwards
+};
+
+enum class CollisionDetectionMode : uint8_t {
+	Querries,		// every entity querries the broadphases of the categories it collides with, so every pair is tested from both sides
+	UniquePairs,	// the broadphase querries are turned into a sorted list of unique pairs, every pair is tested once
+	SweepAndPrune	// one sort and sweep over all categories reports every overlapping pair once, the broadphases are not used
+};
+
+enum class TriggerEventType : uint8_t {
+	Enter,	// the entity started to overlap the sensor
+	Stay,	// the entity overlapped the sensor in the last execute and still does
+	Exit	// the entity stopped to overlap the sensor, it may be destroyed allready
+};
+
+/**
+ * overlap change of a sensor in trigger mode.
+ */
+struct TriggerEvent {
+	EntityHandleIndex sensor;
+	EntityHandleIndex other;
+	TriggerEventType type;
+};
+
+/**
+ * hit of a raycast or shape cast.
+ */
+struct QueryHit {
+	EntityHandleIndex entity{ INVALID_ENTITY_HANDLE_INDEX };
+	float fraction{ 1.0f };		// fraction of the cast at the hit, 0 if the cast starts inside of the entity
+	Vec2 position{ 0, 0 };		// raycast: hit point on the surface, shape cast: position of the cast shape at the hit
+	Vec2 normal{ 0, 0 };		// surface normal of the hit entity, points against the cast
+};
+
+struct RayQuery {
+	Vec2 origin;
+	Vec2 end;
+};
+
+struct AABBQuery {
+	Vec2 position;
+	Vec2 size;
+};
+
 class CollisionSystem {
 	friend class PhysicsSystem;
 	friend class PhysicsSystem2;
@@ -67,10 +142,19 @@ public:
 	};
 
 	CollisionSystem(CollisionSECM secm, uint32_t qtreeCapacity = 6);
+	~CollisionSystem();
 
 	void execute(CollisionSECM secm, float deltaTime);
 
-	std::vector<std::vector<CollisionInfo>>& getCollisionsLists();
+	/**
+	 * \return collision infos of the last execute in one contiguous array, ordered by indexA.
+	 */
+	const std::vector<CollisionInfo>& getCollisions() const { return collisions; }
+
+	/**
+	 * \return offsets into getCollisions() indexed by entity, the infos of entity e are in [offsets[e], offsets[e+1]).
+	 */
+	const std::vector<uint32_t>& getCollisionOffsets() const { return collisionOffsets; }
 
 	const CollisionsView collisions_view(EntityHandle entity)
 	{
@@ -83,46 +167,367 @@ public:
 
 	void checkForCollisions(std::vector<CollisionInfo>& collisions, uint8_t colliderType, Transform const& b, Collider const& c) const;
 
+	/*
+		Spatial querries.
+		They read the broadphases and aabbs of the last execute, so they are valid from the end of execute until the next execute starts.
+		In that time they can be called from multiple jobs at the same time,
+		as they only read the components through the const accessors of the CollisionSECM.
+		Results are appended to the given buffers, so buffers that are reused do not allocate.
+		Temporary buffers are taken from the frame arena of the calling thread.
+		Every entity is reported at most once per querry, in increasing entity order.
+		colliderCategories is a combination of Collider::DYNAMIC, STATIC, PARTICLE and SENSOR.
+	*/
+
+	/**
+	 * appends all entities whose aabb overlaps with the box.
+	 */
+	void querryAABB(std::vector<EntityHandleIndex>& result, Vec2 position, Vec2 size, uint8_t colliderCategories) const;
+
+	/**
+	 * appends all entities whose collider contains the point.
+	 */
+	void querryPoint(std::vector<EntityHandleIndex>& result, Vec2 point, uint8_t colliderCategories) const;
+
+	/**
+	 * appends all entities whose collider overlaps with the circle.
+	 */
+	void querryCircle(std::vector<EntityHandleIndex>& result, Vec2 center, float radius, uint8_t colliderCategories) const;
+
+	/**
+	 * appends all entities whose collider overlaps with the given collider.
+	 */
+	void querryShape(std::vector<EntityHandleIndex>& result, Transform const& transform, Collider const& collider, uint8_t colliderCategories) const;
+
+	/**
+	 * \return first entity hit by the segment from origin to end.
+	 */
+	std::optional<QueryHit> raycast(Vec2 origin, Vec2 end, uint8_t colliderCategories) const;
+
+	/**
+	 * moves the collider from start by translation and finds the first entity it touches.
+	 * For every candidate the sweep is only sampled where the aabbs overlap, in steps of half the smaller collider extent, the first contact is then refined by bisection.
+	 * The samples do not depend on the cast length. Only grazed corners and colliders far thinner than the aabbs they overlap with can be missed, as the samples per candidate are capped at MAX_SHAPE_CAST_STEPS.
+	 * 
+	 * \return first entity hit by the moving collider.
+	 */
+	std::optional<QueryHit> shapeCast(Transform const& start, Collider const& collider, Vec2 translation, uint8_t colliderCategories) const;
+
+	/*
+		Batched querries are processed in parallel, so they must not be called from inside a job.
+	*/
+
+	/**
+	 * \param results the entities overlapping querries[i] are written to results[i], the buffers are cleared first.
+	 */
+	void querryAABBBatch(std::vector<AABBQuery> const& querries, std::vector<std::vector<EntityHandleIndex>>& results, uint8_t colliderCategories) const;
+
+	/**
+	 * \param hits hits[i] is the result of rays[i].
+	 */
+	void raycastBatch(std::vector<RayQuery> const& rays, std::vector<std::optional<QueryHit>>& hits, uint8_t colliderCategories) const;
+
 	void disableColliderDetection(uint8_t colliderFlags)
 	{
 		colliderDetectionEnableFlags &= ~colliderFlags;
+		rebuildStatic |= (colliderFlags & Collider::STATIC) != 0;
+		rebuildSleeping |= (colliderFlags & Collider::DYNAMIC) != 0;
 	}
 
 	void enableColliderDetection(uint8_t colliderFlags)
 	{
 		colliderDetectionEnableFlags |= colliderFlags;
+		rebuildStatic |= (colliderFlags & Collider::STATIC) != 0;
+		rebuildSleeping |= (colliderFlags & Collider::DYNAMIC) != 0;
 	}
 
+	/**
+	 * sets the broadphase used for the given collider categories.
+	 * The new broadphase is filled in the next execute.
+	 * 
+	 * \param colliderFlags combination of Collider::DYNAMIC, STATIC, PARTICLE and SENSOR.
+	 */
+	void setBroadphase(uint8_t colliderFlags, BroadphaseType type);
+
+	/**
+	 * sets how potential collisions are found.
+	 * In UniquePairs and SweepAndPrune mode, every pair is tested once and the collision info of the second entity is mirrored from the first.
+	 */
+	void setDetectionMode(CollisionDetectionMode mode);
+
+	CollisionDetectionMode getDetectionMode() const { return detectionMode; }
+
+	/**
+	 * enables skipping of ignored collision groups inside of the broadphases. On by default.
+	 * Turning it off gives the same collisions, the ignored candidates are then rejected after the broadphase querries.
+	 */
+	void setBroadphaseMaskCulling(bool enable) { broadphaseMaskCulling = enable; }
+
+	bool getBroadphaseMaskCulling() const { return broadphaseMaskCulling; }
+
+	/**
+	 * Bakes the static colliders into a signed distance field, it is baked again whenever the statics change.
+	 * Dynamic and particle colliders that are single circles are then tested against all statics with one lookup in the field,
+	 * instead of querrying the static broadphase and running the collision tests.
+	 * These circles get a collision info with the static nearest to them, the statics get no collision infos for them.
+	 * Circles that ignore a group of any static or are too big for the band of the field use the static broadphase as before.
+	 */
+	void enableStaticSDF(float cellSize = StaticSDF::DEFAULT_CELL_SIZE, float band = StaticSDF::DEFAULT_BAND);
+
+	void disableStaticSDF();
+
+	/**
+	 * \return the static sdf, nullptr if it is disabled.
+	 */
+	const StaticSDF* getStaticSDF() const { return staticSDF.get(); }
+
+	/**
+	 * In trigger mode sensors get no collision infos, their candidates only get an overlap test without a collision manifold.
+	 * The overlapping pairs are compared with the ones of the last execute and reported as trigger events. Off by default.
+	 */
+	void setSensorTriggers(bool enable);
+
+	bool getSensorTriggers() const { return sensorTriggers; }
+
+	/**
+	 * \return trigger events of the last execute, ordered by sensor and then by the other entity.
+	 */
+	const std::vector<TriggerEvent>& getTriggerEvents() const { return triggerEvents; }
+
+	/**
+	 * \return trigger events of the given sensor in the last execute.
+	 */
+	std::span<const TriggerEvent> triggerEvents_view(EntityHandleIndex sensor) const;
+
+	/**
+	 * \return group mask culling counts of the last execute in Querries or UniquePairs mode.
+	 */
+	const GroupMaskCullingStats& getGroupMaskCullingStats() const { return groupMaskCullingStats; }
+
+	/**
+	 * \return count of potentially colliding pairs found in the last execute in UniquePairs or SweepAndPrune mode.
+	 */
+	size_t getPairCount() const { return pairs.size(); }
+
+	/**
+	 * \return counts of the pair narrowphase per shape pair bucket in the last execute, indexed by ShapePairBucket. 
+	 * All zero in Querries mode.
+	 */
+	const std::array<NarrowphaseBucketStats, size_t(ShapePairBucket::Count)>& getNarrowphaseStats() const { return narrowphaseStats; }
+
 	size_t collisionCount() const;
+
+	/**
+	 * The static broadphase is only updated, when a static collider is added, removed or changed.
+	 * 
+	 * \return count of static broadphase updates since creation. Stays constant in a scene with unchanged statics.
+	 */
+	size_t getStaticRebuildCount() const { return staticRebuildCount; }
+
+	/**
+	 * Dynamics with a sleeping Movement are kept in an own broadphase, that is only updated when they change.
+	 * They do not querry, so they only get collision infos from awake colliders.
+	 *
+	 * \return count of sleeping dynamics in the last execute.
+	 */
+	size_t getSleepingCount() const { return sleepingEntities.size(); }
+
+	/**
+	 * \return count of sleeping broadphase updates since creation.
+	 */
+	size_t getSleepingRebuildCount() const { return sleepingRebuildCount; }
 private:
 	void prepare(CollisionSECM secm);
+	/**
+	 * writes the entities whose aabb overlaps the box to near, sorted and without duplicates.
+	 */
+	void collectOverlappingAABBs(FrameVector<EntityHandleIndex>& near, Vec2 position, Vec2 size, uint8_t colliderCategories) const;
+	/**
+	 * \return collision of the given collider with the entity, seen from the given collider.
+	 */
+	std::optional<CollisionInfo> testCollider(Transform const& transform, Collider const& collider, EntityHandleIndex entity, FrameVector<CollPoint>& collPoints) const;
 	void cleanBuffers(CollisionSECM secm);
 	void collisionDetection(CollisionSECM secm);
-	void clearCollisionTokens();
+	void findPairsFromQuerries(CollisionSECM secm);
+	void pairCollisionDetection(CollisionSECM secm);
+	/**
+	 * the sensors querry the broadphases for their trigger candidates.
+	 */
+	void querrySensorCandidates(CollisionSECM secm);
+	/**
+	 * moves the pairs with a sensor from the pairs to the trigger candidates.
+	 */
+	void extractSensorPairs();
+	/**
+	 * overlap tests the trigger candidates and compares the overlapping pairs with the last execute to generate the trigger events.
+	 */
+	void triggerDetection(CollisionSECM secm);
+	/**
+	 * flags the circles that are tested against the static sdf.
+	 */
+	void markSDFCircles();
+	bool isSDFCircle(EntityHandleIndex entity) const { return entity < sdfCircleCache.size() && sdfCircleCache[entity]; }
+	/**
+	 * \return true if one entity is a static sdf circle and the other a static.
+	 */
+	bool isSDFPair(EntityHandleIndex a, EntityHandleIndex b) const
+	{
+		return (isSDFCircle(a) && categoryCache[b] == Collider::STATIC) || (isSDFCircle(b) && categoryCache[a] == Collider::STATIC);
+	}
+	/**
+	 * \return collision of the circle with the nearest static from the static sdf.
+	 * Only reads the sdf and the const components of the circle, so the narrowphase jobs call it in parallel.
+	 */
+	std::optional<CollisionInfo> sdfCollision(EntityHandleIndex circle) const;
+	static uint64_t triggerKey(EntityHandleIndex sensor, EntityHandleIndex other) { return (uint64_t(sensor) << 32) | uint64_t(other); }
+	/**
+	 * compacts the per worker collision lists into one array ordered by entity (CSR layout).
+	 * The infos of every entity are counted, the offsets are a parallel prefix sum of the counts
+	 * and the infos are then copied to their offsets in parallel.
+	 * The collision tokens are pointed at the compacted ranges.
+	 */
+	void compactCollisions(CollisionSECM secm);
+	/**
+	 * \return categories the colliders of the given category collide with.
+	 */
+	static uint8_t querriedCategories(uint8_t colliderTag);
+	/**
+	 * \return broadphases of the categories the colliders of the given category collide with.
+	 * Statics do not look for sleeping dynamics, a sleeping body keeps its static contacts in the physics.
+	 */
+	StaticVector<Broadphase const*, 5> querriedBroadphases(uint8_t colliderTag) const;
+	/**
+	 * \return true for statics and sleeping dynamics, a pair of two resting entities is not tested.
+	 */
+	bool isResting(EntityHandleIndex entity) const
+	{
+		return categoryCache[entity] == Collider::STATIC || (categoryCache[entity] == Collider::DYNAMIC && secm.getComp<Movement>(entity).sleeping);
+	}
+	/**
+	 * \return true if a gets the collision info for its collision with b, the same filters as in the querries apply.
+	 */
+	bool wantsCollisionInfo(EntityHandleIndex a, EntityHandleIndex b) const;
+	void addMissingCollisionTokens();
+	bool haveStaticsChanged();
+	void takeStaticSnapshot();
+	std::unique_ptr<Broadphase> makeBroadphase(BroadphaseType type, uint8_t colliderTag) const;
 
 	std::vector<Sprite> debugSprites;
 
 	CollisionSECM secm;
 	// constants:
 	static const int MAX_ENTITIES_PER_JOB = 200;
+	static const size_t MIN_PAIRS_PER_CHUNK = 256;
+	static const size_t MIN_ENTITIES_PER_PREPARE_CHUNK = 1024;
+	static const size_t MIN_ENTITIES_PER_COMPACT_CHUNK = 1024;
+	static const size_t MIN_COLLISIONS_PER_CHUNK = 1024;
+	static const size_t MIN_TRIGGER_CANDIDATES_PER_CHUNK = 256;
+	static const size_t MIN_QUERRIES_PER_CHUNK = 64;
+	static const size_t MAX_SHAPE_CAST_STEPS = 256;
+	static const size_t SHAPE_CAST_BISECTIONS = 12;
 	uint32_t qtreeCapacity;
 	bool rebuildStaticData;
 	// flags:
 	bool rebuildStatic = true;
+	bool rebuildSleeping = true;
 	// buffers
-	Quadtree qtreeDynamic;
-	Quadtree qtreeStatic;
-	Quadtree qtreeParticle;
-	Quadtree qtreeSensor;
+	std::unique_ptr<Broadphase> dynamicBroadphase;
+	std::unique_ptr<Broadphase> staticBroadphase;
+	std::unique_ptr<Broadphase> particleBroadphase;
+	std::unique_ptr<Broadphase> sensorBroadphase;
+	std::unique_ptr<Broadphase> sleepingBroadphase;		// dynamics with a sleeping Movement, tagged as dynamic
 	uint8_t colliderDetectionEnableFlags{ 0xFF };
+	CollisionDetectionMode detectionMode{ CollisionDetectionMode::Querries };
+	bool broadphaseMaskCulling{ true };
+	std::vector<GroupMaskCullingStats> workerMaskStats;
+	GroupMaskCullingStats groupMaskCullingStats;
+	SweepAndPrune sweepAndPrune;
+	std::vector<EntityPair> pairs;
+	std::vector<std::vector<EntityPair>> workerPairs;
+	// per chunk buffers of the pair narrowphase:
+	struct PairChunk {
+		std::vector<CollisionInfo> infos;
+		ShapePairBatch circleCircle;
+		ShapePairBatch circleRectangle;		// the circle is allways shape a
+		ShapePairBatch rectangleRectangle;
+		std::vector<uint32_t> compound;		// pair ids
+		std::vector<uint32_t> overlapping;
+		std::array<NarrowphaseBucketStats, size_t(ShapePairBucket::Count)> stats;
+	};
+	std::vector<PairChunk> pairChunks;
+	// trigger mode, sensor pairs are keyed by triggerKey:
+	bool sensorTriggers{ false };
+	std::vector<std::vector<uint64_t>> workerTriggerCandidates;
+	std::vector<uint64_t> triggerCandidates;
+	std::vector<uint8_t> triggerOverlaps;		// per candidate
+	struct TriggerChunk {
+		ShapePairBatch circleCircle;
+		ShapePairBatch circleRectangle;		// the circle is allways shape a
+		ShapePairBatch rectangleRectangle;
+		std::vector<uint32_t> overlapping;
+	};
+	std::vector<TriggerChunk> triggerChunks;
+	std::vector<uint64_t> triggerPairs;			// overlapping pairs, sorted
+	std::vector<uint64_t> lastTriggerPairs;
+	std::vector<TriggerEvent> triggerEvents;
+	std::array<NarrowphaseBucketStats, size_t(ShapePairBucket::Count)> narrowphaseStats;
 
-	std::vector<Vec2> aabbCache;
+	// per chunk results of the prepare pass, merged in chunk order:
+	struct PrepareChunk {
+		std::vector<EntityHandleIndex> sensors;
+		std::vector<EntityHandleIndex> particles;
+		std::vector<EntityHandleIndex> dynamics;
+		std::vector<EntityHandleIndex> sleeping;
+		std::vector<EntityHandleIndex> statics;
+		Vec2 minPos;
+		Vec2 maxPos;
+	};
+	std::vector<PrepareChunk> prepareChunks;
+
+	std::vector<Vec2> aabbCache;		// indexed by entity, only grows
+	std::vector<uint8_t> categoryCache;	// collider category, indexed by entity
+
+	std::unique_ptr<StaticSDF> staticSDF;	// nullptr if disabled
+	bool staticSDFDirty{ false };
+	std::vector<uint8_t> sdfCircleCache;	// 1 for circles tested against the static sdf, indexed by entity, empty if unused
+	std::vector<std::vector<CollisionInfo>> workerSDFInfos;	// pair modes
 
 	std::vector<EntityHandleIndex> sensorEntities;
 	std::vector<EntityHandleIndex> particleEntities;
-	std::vector<EntityHandleIndex> dynamicSolidEntities;
+	std::vector<EntityHandleIndex> dynamicSolidEntities;		// awake dynamics
+	std::vector<EntityHandleIndex> sleepingEntities;			// sleeping dynamics
 	std::vector<EntityHandleIndex> staticSolidEntities;
-	std::vector<std::vector<CollisionInfo>> collisionLists;
+	std::vector<std::vector<CollisionInfo>> collisionLists;	// narrowphase output per worker, compacted into collisions
+	// compacted collision infos, the buffers keep their capacity, so frames with no more collisions than before do not allocate:
+	struct CollisionRun {
+		uint32_t list;
+		uint32_t begin;
+	};
+	std::vector<CollisionRun> collisionRuns;	// position of the infos of an entity in collisionLists, indexed by entity
+	std::vector<uint32_t> collisionOffsets;		// indexed by entity, plus the total count at the end
+	std::vector<uint32_t> collisionOffsetChunkSums;	// scratch of the parallel scan of collisionOffsets
+	std::vector<CollisionInfo> collisions;
+
+	// static and sleeping change tracking:
+	struct StaticColliderState {
+		EntityHandleIndex entity;
+		Vec2 position;
+		RotaVec2 rotaVec;
+		Vec2 aabb;
+	};
+	/**
+	 * \return true if the entities or their transforms and aabbs differ from the snapshot.
+	 */
+	bool differsFromSnapshot(const std::vector<EntityHandleIndex>& entities, const std::vector<StaticColliderState>& snapshot) const;
+
+	// the events of these storages can turn an entity into a static collider or remove it from the statics:
+	ComponentEventQueue colliderEvents;
+	ComponentEventQueue physicsBodyEvents;
+	ComponentEventQueue movementEvents;
+	std::vector<StaticColliderState> staticSnapshot;	// statics as they were at the last static broadphase update
+	std::vector<bool> isInStaticSnapshot;				// indexed by entity
+	size_t staticRebuildCount{ 0 };
+	std::vector<StaticColliderState> sleepingSnapshot;	// sleeping dynamics as they were at the last sleeping broadphase update
+	size_t sleepingRebuildCount{ 0 };
 
 	std::vector<CollisionInfo> dummy{ {} };
 
@@ -1,4 +1,13 @@
 #pragma once
+#include <vector>
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <type_traits>
+
 #include "../../engine/types/BaseTypes.hpp"
 #include "../../engine/math/Vec.hpp"
 #include "../../engine/entity/EntityComponentStorage.hpp"
@@ -34,6 +43,7 @@ struct Movement {
 
 	Vec2 velocity;
 	float angleVelocity;
+	bool sleeping{ false };	// set by the physics for resting bodies, cleared on contact with an awake body, on a velocity or a transform change
 };
 
 using CollisionMask = uint16_t;
@@ -54,12 +64,133 @@ struct CompountCollider {
 		:size{size}, relativePos{ relativePos }, relativeRota{ relativeRota }, form{ form }
 	{}
 
+	bool operator==(const CompountCollider& other) const
+	{
+		return size == other.size && relativePos == other.relativePos && relativeRota.sin == other.relativeRota.sin && relativeRota.cos == other.relativeRota.cos && form == other.form;
+	}
+
 	Vec2 size{0,0};
 	Vec2 relativePos{0,0};
 	RotaVec2 relativeRota{0,0};
 	Form form{Form::Rectangle};
 };
 
+/**
+ * handle of an interned list of compound colliders, 0 is the empty list.
+ */
+using CompoundHandle = uint32_t;
+
+/**
+ * Shared storage of the compound children of colliders.
+ * Lists are interned: equal lists get the same handle, so the children of many colliders with the same shape are stored once.
+ * Interned lists are immutable and never freed, a collider that changes its children gets a new handle.
+ * The pool therefore only grows with the count of distinct lists ever set, not with the count of colliders or frames.
+ * This keeps the Collider component trivially copyable.
+ * Children and ranges are stored in fixed chunks that are never moved or freed, so getting a list takes no lock.
+ */
+class CompoundColliderPool {
+public:
+	/**
+	 * Can be called from multiple threads at the same time, also while other threads get lists.
+	 * 
+	 * \return handle of the list, 0 if it is empty.
+	 */
+	static CompoundHandle intern(std::span<const CompountCollider> children)
+	{
+		if (children.empty()) return 0;
+		const size_t hash = hashOf(children);
+		std::unique_lock lock(mut);
+		auto [begin, end] = handles.equal_range(hash);
+		for (auto iter = begin; iter != end; ++iter) {
+			const Range& stored = range(iter->second);
+			if (std::equal(stored.data, stored.data + stored.count, children.begin(), children.end())) {
+				return iter->second;
+			}
+		}
+		if (chunks.empty() || chunkUsed + children.size() > CHUNK_SIZE) {
+			// a list is never split over chunks, lists longer than a chunk get their own:
+			chunks.push_back(std::make_unique<CompountCollider[]>(std::max(CHUNK_SIZE, children.size())));
+			chunkUsed = 0;
+		}
+		CompountCollider* data = chunks.back().get() + chunkUsed;
+		std::copy(children.begin(), children.end(), data);
+		chunkUsed += children.size();
+		storedChildCount.fetch_add(children.size(), std::memory_order_relaxed);
+
+		const size_t rangeIndex = rangeCount++;
+		if (rangeIndex % RANGE_CHUNK_SIZE == 0) {
+			if (rangeIndex / RANGE_CHUNK_SIZE >= MAX_RANGE_CHUNKS) {
+				throw new std::exception("compound collider pool is full");
+			}
+			rangeChunkStorage.push_back(std::make_unique<Range[]>(RANGE_CHUNK_SIZE));
+			rangeChunks[rangeIndex / RANGE_CHUNK_SIZE].store(rangeChunkStorage.back().get(), std::memory_order_release);
+		}
+		rangeChunks[rangeIndex / RANGE_CHUNK_SIZE].load(std::memory_order_relaxed)[rangeIndex % RANGE_CHUNK_SIZE] = Range{ data, uint32_t(children.size()) };
+		const CompoundHandle handle = CompoundHandle(rangeIndex + 1);
+		handles.insert({ hash, handle });
+		return handle;
+	}
+
+	/**
+	 * Can be called from multiple threads at the same time, also while other threads intern lists.
+	 * Takes no lock: the range of a handle is written before the handle is returned by intern and is never changed,
+	 * so whoever got the handle can read the range.
+	 * 
+	 * \return the interned list, the children are never moved so it stays valid.
+	 */
+	static std::span<const CompountCollider> get(CompoundHandle handle)
+	{
+		if (handle == 0) return {};
+		const Range& stored = range(handle);
+		return { stored.data, stored.count };
+	}
+
+	/**
+	 * \return count of stored children of all interned lists.
+	 */
+	static size_t storedChildren()
+	{
+		return storedChildCount.load(std::memory_order_relaxed);
+	}
+private:
+	struct Range {
+		const CompountCollider* data;
+		uint32_t count;
+	};
+
+	static constexpr size_t CHUNK_SIZE{ 256 };
+	static constexpr size_t RANGE_CHUNK_SIZE{ 1024 };
+	static constexpr size_t MAX_RANGE_CHUNKS{ 1024 };
+
+	static const Range& range(CompoundHandle handle)
+	{
+		const size_t index = handle - 1;
+		return rangeChunks[index / RANGE_CHUNK_SIZE].load(std::memory_order_acquire)[index % RANGE_CHUNK_SIZE];
+	}
+
+	static size_t hashOf(std::span<const CompountCollider> children)
+	{
+		size_t hash = children.size();
+		auto combine = [&](float f) { hash ^= std::hash<float>()(f) + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+		for (const auto& c : children) {
+			combine(c.size.x); combine(c.size.y);
+			combine(c.relativePos.x); combine(c.relativePos.y);
+			combine(c.relativeRota.cos); combine(c.relativeRota.sin);
+			combine(float(c.form));
+		}
+		return hash;
+	}
+
+	inline static std::mutex mut;											// serializes intern, get does not lock
+	inline static std::vector<std::unique_ptr<CompountCollider[]>> chunks;	// never reallocated, so the children never move
+	inline static size_t chunkUsed{ 0 };									// used children of the last chunk
+	inline static std::atomic<size_t> storedChildCount{ 0 };
+	inline static std::atomic<Range*> rangeChunks[MAX_RANGE_CHUNKS]{};	// fixed table of the range chunks, range of handle h is at h - 1
+	inline static std::vector<std::unique_ptr<Range[]>> rangeChunkStorage;	// owns the range chunks
+	inline static size_t rangeCount{ 0 };
+	inline static std::unordered_multimap<size_t, CompoundHandle> handles;	// by hash of the list
+};
+
 struct Collider {
 	Collider(Vec2 size = { 1,1 }, Form form = Form::Circle, bool particle = false) :
 		size{ size },
@@ -97,6 +228,24 @@ struct Collider {
 		return (collisionSettings & (mask << 4)) != false;
 	}
 
+	/**
+	 * replaces the compound children, they are interned in the CompoundColliderPool.
+	 */
+	void setExtraColliders(const std::vector<CompountCollider>& children)
+	{
+		compound = CompoundColliderPool::intern(children);
+	}
+
+	/**
+	 * \return the compound children, they stay valid after changes of the children.
+	 */
+	std::span<const CompountCollider> extraColliders() const
+	{
+		return CompoundColliderPool::get(compound);
+	}
+
+	bool hasExtraColliders() const { return compound != 0; }
+
 	static const uint8_t DYNAMIC = 1 << 0;
 	static const uint8_t STATIC = 1 << 1;
 	static const uint8_t PARTICLE = 1 << 2;
@@ -105,7 +254,7 @@ struct Collider {
 	Vec2 size;
 	CollisionMask ignoreGroupMask = 0;
 	CollisionMask groupMask = CollisionGroup<0>::mask;
-	std::vector<CompountCollider> extraColliders;
+	CompoundHandle compound{ 0 };	// children in the CompoundColliderPool
 	bool particle;
 	Form form;
 	// lower 4 bits: who am i ignoring?
@@ -113,10 +262,12 @@ struct Collider {
 	uint8_t collisionSettings = 0;
 };
 
+static_assert(std::is_trivially_copyable_v<Collider>, "colliders are copied by the component storages, the compound children are in the CompoundColliderPool");
+
 struct CollisionsToken {
 private:
 	friend class CollisionSystem;
-	uint32_t workerIndex{ 0 };
+	// range of the entities collision infos in the compacted collisions of the CollisionSystem:
 	uint32_t begin{ 0 };
 	uint32_t end{ 0 };
 };
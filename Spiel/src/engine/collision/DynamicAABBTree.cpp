@@ -0,0 +1,366 @@
+#include "DynamicAABBTree.hpp"
+
+DynamicAABBTree::DynamicAABBTree(CollisionSECM world, uint8_t TAG, float fatMargin) :
+	Broadphase{ TAG },
+	world{ world },
+	fatMargin{ fatMargin }
+{ }
+
+void DynamicAABBTree::update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos)
+{
+	updateCount += 1;
+	lastUpdateChangeCount = 0;
+
+	if (entityToLeaf.size() < aabbs.size()) {
+		entityToLeaf.resize(aabbs.size(), NULL_NODE);
+		entityLastUpdate.resize(aabbs.size(), 0);
+	}
+
+	for (const auto ent : entities) {
+		const Collider& collider = world.getComp<Collider>(ent);
+		if (collider.isIgnoredBy(COLLIDER_TAG)) continue;
+
+		entityLastUpdate[ent] = updateCount;
+		const Vec2 position = world.getComp<Transform>(ent).position;
+		const AABB tight{ position - aabbs[ent] * 0.5f, position + aabbs[ent] * 0.5f };
+
+		int32_t leaf = entityToLeaf[ent];
+		if (leaf != NULL_NODE) {
+			if (nodes[leaf].aabb.contains(tight)) {
+				// entity stayed inside its fat aabb, only a changed group mask has to be propagated:
+				if (nodes[leaf].sharedGroupMask != collider.groupMask) {
+					nodes[leaf].sharedGroupMask = collider.groupMask;
+					refitUpwards(nodes[leaf].parent);
+				}
+				continue;
+			}
+			removeLeaf(leaf);
+		}
+		else {
+			leaf = allocateNode();
+			nodes[leaf].entity = ent;
+			nodes[leaf].height = 0;
+			entityToLeaf[ent] = leaf;
+			members.push_back(ent);
+		}
+		nodes[leaf].aabb = AABB{ tight.min - Vec2{ fatMargin, fatMargin }, tight.max + Vec2{ fatMargin, fatMargin } };
+		nodes[leaf].sharedGroupMask = collider.groupMask;
+		insertLeaf(leaf);
+		lastUpdateChangeCount += 1;
+	}
+
+	// remove all entities that were not part of this update:
+	for (size_t i = 0; i < members.size();) {
+		const auto ent = members[i];
+		if (entityLastUpdate[ent] != updateCount) {
+			const int32_t leaf = entityToLeaf[ent];
+			removeLeaf(leaf);
+			freeNode(leaf);
+			entityToLeaf[ent] = NULL_NODE;
+			members[i] = members.back();
+			members.pop_back();
+			lastUpdateChangeCount += 1;
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+void DynamicAABBTree::querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const
+{
+	if (rootNode == NULL_NODE) return;
+
+	const AABB qry{ qryPos - qrySize * 0.5f, qryPos + qrySize * 0.5f };
+
+	// the stack is kept per thread, so that querries do not allocate:
+	thread_local std::vector<int32_t> stack;
+	stack.clear();
+	stack.push_back(rootNode);
+
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.aabb.overlaps(qry)) {
+			if (node.sharedGroupMask & ignoreGroupMask) {
+				if (node.isLeaf()) {
+					stats.culledEntities += 1;
+				}
+				else {
+					stats.culledNodes += 1;
+				}
+			}
+			else if (node.isLeaf()) {
+				rVec.push_back(node.entity);
+			}
+			else {
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+}
+
+void DynamicAABBTree::querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const
+{
+	for (const auto& node : nodes) {
+		if (node.height == 0) {
+			const Vec2 pos = (node.aabb.min + node.aabb.max) * 0.5f;
+			const Vec2 size = node.aabb.max - node.aabb.min;
+			draw.push_back(makeSprite(0, pos, 0.1f, size, Vec4(0, 0, 0, 1), Form::Rectangle, RotaVec2(0)));
+			draw.push_back(makeSprite(0, pos, 0.11f, size - Vec2(0.02f, 0.02f), color, Form::Rectangle, RotaVec2(0)));
+		}
+	}
+}
+
+int32_t DynamicAABBTree::allocateNode()
+{
+	if (freeList == NULL_NODE) {
+		nodes.push_back(Node{});
+		return int32_t(nodes.size() - 1);
+	}
+	else {
+		const int32_t node = freeList;
+		freeList = nodes[node].parent;
+		nodes[node] = Node{};
+		return node;
+	}
+}
+
+void DynamicAABBTree::freeNode(int32_t node)
+{
+	nodes[node] = Node{};
+	nodes[node].parent = freeList;
+	freeList = node;
+}
+
+void DynamicAABBTree::insertLeaf(int32_t leaf)
+{
+	if (rootNode == NULL_NODE) {
+		rootNode = leaf;
+		nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// find the best sibling by the perimeter cost heuristic:
+	const AABB leafAABB = nodes[leaf].aabb;
+	int32_t index = rootNode;
+	while (!nodes[index].isLeaf()) {
+		const Node& node = nodes[index];
+
+		const float perimeter = node.aabb.perimeter();
+		const float combinedPerimeter = AABB::combine(node.aabb, leafAABB).perimeter();
+
+		// cost of creating a new parent for this node and the new leaf:
+		const float cost = 2.0f * combinedPerimeter;
+		// minimum cost of pushing the leaf further down the tree:
+		const float inheritanceCost = 2.0f * (combinedPerimeter - perimeter);
+
+		auto descendCost = [&](int32_t child) {
+			const AABB combined = AABB::combine(leafAABB, nodes[child].aabb);
+			if (nodes[child].isLeaf()) {
+				return combined.perimeter() + inheritanceCost;
+			}
+			else {
+				return combined.perimeter() - nodes[child].aabb.perimeter() + inheritanceCost;
+			}
+		};
+		const float cost1 = descendCost(node.child1);
+		const float cost2 = descendCost(node.child2);
+
+		if (cost < cost1 && cost < cost2) {
+			break;
+		}
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+	const int32_t sibling = index;
+
+	// create a new parent for the sibling and the leaf:
+	const int32_t oldParent = nodes[sibling].parent;
+	const int32_t newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].aabb = AABB::combine(leafAABB, nodes[sibling].aabb);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].sharedGroupMask = nodes[sibling].sharedGroupMask & nodes[leaf].sharedGroupMask;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != NULL_NODE) {
+		if (nodes[oldParent].child1 == sibling) {
+			nodes[oldParent].child1 = newParent;
+		}
+		else {
+			nodes[oldParent].child2 = newParent;
+		}
+	}
+	else {
+		rootNode = newParent;
+	}
+
+	refitUpwards(nodes[leaf].parent);
+}
+
+void DynamicAABBTree::removeLeaf(int32_t leaf)
+{
+	if (leaf == rootNode) {
+		rootNode = NULL_NODE;
+		return;
+	}
+
+	const int32_t parent = nodes[leaf].parent;
+	const int32_t grandParent = nodes[parent].parent;
+	const int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent != NULL_NODE) {
+		// replace the parent with the sibling:
+		if (nodes[grandParent].child1 == parent) {
+			nodes[grandParent].child1 = sibling;
+		}
+		else {
+			nodes[grandParent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+		refitUpwards(grandParent);
+	}
+	else {
+		rootNode = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		freeNode(parent);
+	}
+	nodes[leaf].parent = NULL_NODE;
+}
+
+void DynamicAABBTree::refitUpwards(int32_t index)
+{
+	while (index != NULL_NODE) {
+		index = balance(index);
+
+		Node& node = nodes[index];
+		node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+		node.aabb = AABB::combine(nodes[node.child1].aabb, nodes[node.child2].aabb);
+		node.sharedGroupMask = nodes[node.child1].sharedGroupMask & nodes[node.child2].sharedGroupMask;
+
+		index = node.parent;
+	}
+}
+
+/*
+	performs a left or right rotation if the subtree at iA is imbalanced.
+	returns the new root of the subtree.
+*/
+int32_t DynamicAABBTree::balance(int32_t iA)
+{
+	Node& A = nodes[iA];
+	if (A.isLeaf() || A.height < 2) {
+		return iA;
+	}
+
+	const int32_t iB = A.child1;
+	const int32_t iC = A.child2;
+	Node& B = nodes[iB];
+	Node& C = nodes[iC];
+
+	const int32_t imbalance = C.height - B.height;
+
+	// rotate C up:
+	if (imbalance > 1) {
+		const int32_t iF = C.child1;
+		const int32_t iG = C.child2;
+		Node& F = nodes[iF];
+		Node& G = nodes[iG];
+
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+
+		if (C.parent != NULL_NODE) {
+			if (nodes[C.parent].child1 == iA) {
+				nodes[C.parent].child1 = iC;
+			}
+			else {
+				nodes[C.parent].child2 = iC;
+			}
+		}
+		else {
+			rootNode = iC;
+		}
+
+		if (F.height > G.height) {
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.aabb = AABB::combine(B.aabb, G.aabb);
+			C.aabb = AABB::combine(A.aabb, F.aabb);
+			A.sharedGroupMask = B.sharedGroupMask & G.sharedGroupMask;
+			C.sharedGroupMask = A.sharedGroupMask & F.sharedGroupMask;
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		}
+		else {
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.aabb = AABB::combine(B.aabb, F.aabb);
+			C.aabb = AABB::combine(A.aabb, G.aabb);
+			A.sharedGroupMask = B.sharedGroupMask & F.sharedGroupMask;
+			C.sharedGroupMask = A.sharedGroupMask & G.sharedGroupMask;
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+		return iC;
+	}
+
+	// rotate B up:
+	if (imbalance < -1) {
+		const int32_t iD = B.child1;
+		const int32_t iE = B.child2;
+		Node& D = nodes[iD];
+		Node& E = nodes[iE];
+
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+
+		if (B.parent != NULL_NODE) {
+			if (nodes[B.parent].child1 == iA) {
+				nodes[B.parent].child1 = iB;
+			}
+			else {
+				nodes[B.parent].child2 = iB;
+			}
+		}
+		else {
+			rootNode = iB;
+		}
+
+		if (D.height > E.height) {
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.aabb = AABB::combine(C.aabb, E.aabb);
+			B.aabb = AABB::combine(A.aabb, D.aabb);
+			A.sharedGroupMask = C.sharedGroupMask & E.sharedGroupMask;
+			B.sharedGroupMask = A.sharedGroupMask & D.sharedGroupMask;
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		}
+		else {
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.aabb = AABB::combine(C.aabb, D.aabb);
+			B.aabb = AABB::combine(A.aabb, E.aabb);
+			A.sharedGroupMask = C.sharedGroupMask & D.sharedGroupMask;
+			B.sharedGroupMask = A.sharedGroupMask & E.sharedGroupMask;
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
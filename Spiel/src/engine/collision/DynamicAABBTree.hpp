@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+
+#include "CollisionUniform.hpp"
+#include "Broadphase.hpp"
+
+/**
+ * Persistent bounding volume hierarchy over fattened aabbs.
+ * Every entity is a leaf with an aabb that is enlarged by a margin.
+ * As long as the real aabb of an entity stays inside of its fat aabb, the tree is not changed for it.
+ * Only entities that left their fat aabb, new entities and removed entities are touched in update,
+ * so the maintenance cost scales with the number of moved entities, not with the entity count.
+ * Inner nodes are kept balanced with tree rotations.
+ */
+class DynamicAABBTree : public Broadphase {
+public:
+	static constexpr float DEFAULT_FAT_MARGIN{ 0.1f };
+
+	DynamicAABBTree(CollisionSECM world, uint8_t TAG = 0, float fatMargin = DEFAULT_FAT_MARGIN);
+
+	void update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos) override;
+
+	using Broadphase::querry;
+	void querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const override;
+
+	void querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const override;
+
+	/**
+	 * \return count of entities in the tree.
+	 */
+	size_t size() const { return members.size(); }
+
+	/**
+	 * \return count of entities that were inserted, reinserted or removed in the last update.
+	 */
+	size_t getLastUpdateChangeCount() const { return lastUpdateChangeCount; }
+
+	/**
+	 * \return height of the tree, 0 if empty.
+	 */
+	int height() const { return rootNode == NULL_NODE ? 0 : nodes[rootNode].height + 1; }
+private:
+	static constexpr int32_t NULL_NODE{ -1 };
+
+	struct AABB {
+		Vec2 min;
+		Vec2 max;
+
+		bool contains(AABB const& other) const
+		{
+			return min.x <= other.min.x && min.y <= other.min.y && other.max.x <= max.x && other.max.y <= max.y;
+		}
+		bool overlaps(AABB const& other) const
+		{
+			return !(other.min.x > max.x || other.max.x < min.x || other.min.y > max.y || other.max.y < min.y);
+		}
+		float perimeter() const
+		{
+			return 2.0f * ((max.x - min.x) + (max.y - min.y));
+		}
+		static AABB combine(AABB const& a, AABB const& b)
+		{
+			return AABB{ ::min(a.min, b.min), ::max(a.max, b.max) };
+		}
+	};
+
+	struct Node {
+		bool isLeaf() const { return child1 == NULL_NODE; }
+
+		AABB aabb;
+		int32_t parent{ NULL_NODE };	// next free node, when the node is in the free list
+		int32_t child1{ NULL_NODE };
+		int32_t child2{ NULL_NODE };
+		int32_t height{ -1 };			// leafs have height 0, free nodes -1
+		CollisionMask sharedGroupMask{ 0 };	// group bits of the entity for leafs, the bits shared by both children for inner nodes
+		EntityHandleIndex entity{ INVALID_ENTITY_HANDLE_INDEX };
+	};
+
+	int32_t allocateNode();
+	void freeNode(int32_t node);
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	int32_t balance(int32_t iA);
+	void refitUpwards(int32_t index);
+
+	CollisionSECM world;
+	float fatMargin;
+
+	std::vector<Node> nodes;
+	int32_t freeList{ NULL_NODE };
+	int32_t rootNode{ NULL_NODE };
+
+	std::vector<int32_t> entityToLeaf;			// indexed by entity, NULL_NODE for entities that are not in the tree
+	std::vector<uint32_t> entityLastUpdate;		// indexed by entity, the update in wich the entity was last seen
+	std::vector<EntityHandleIndex> members;
+	uint32_t updateCount{ 0 };
+	size_t lastUpdateChangeCount{ 0 };
+};
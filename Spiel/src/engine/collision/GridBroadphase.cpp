@@ -0,0 +1,221 @@
+#include "GridBroadphase.hpp"
+
+GridBroadphase::GridBroadphase(CollisionSECM world, uint8_t TAG, Mode mode, float cellSize) :
+	Broadphase{ TAG },
+	world{ world },
+	mode{ mode },
+	fixedCellSize{ cellSize }
+{ }
+
+void GridBroadphase::update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos)
+{
+	const size_t chunks = JobSystem::chunkCount(entities.size(), MIN_ENTITIES_PER_CHUNK);
+
+	// pass 1: average and maximum extent of the entities:
+	chunkStats.assign(chunks, ExtentStats{});
+	JobSystem::parallelForChunks(entities.size(), chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			ExtentStats stats;
+			for (size_t i = begin; i < end; ++i) {
+				const Vec2 aabb = aabbs[entities[i]];
+				stats.extentSum += std::max(aabb.x, aabb.y);
+				stats.maxHalfExtent = max(stats.maxHalfExtent, aabb * 0.5f);
+			}
+			chunkStats[chunk] = stats;
+		}
+	);
+	float extentSum{ 0.0f };
+	maxHalfExtent = Vec2{ 0, 0 };
+	for (const auto& stats : chunkStats) {
+		extentSum += stats.extentSum;
+		maxHalfExtent = max(maxHalfExtent, stats.maxHalfExtent);
+	}
+	setupCells(entities.size(), entities.empty() ? 1.0f : extentSum / float(entities.size()), minPos, maxPos);
+
+	// pass 2: find the cell of every entity and count the entities per cell:
+	entityCells.resize(entities.size());
+	for (size_t c = 0; c < cellCount; ++c) {
+		cellCounters[c].store(0, std::memory_order_relaxed);
+	}
+	JobSystem::parallelForChunks(entities.size(), chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				const auto ent = entities[i];
+				if (world.getComp<Collider>(ent).isIgnoredBy(COLLIDER_TAG)) {
+					entityCells[i] = INVALID_CELL;
+					continue;
+				}
+				const Vec2 pos = world.getComp<Transform>(ent).position;
+				const uint32_t cell = cellIndex(cellCoordX(pos.x), cellCoordY(pos.y));
+				entityCells[i] = cell;
+				cellCounters[cell].fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	);
+
+	// exclusive prefix sum of the counts gives the start of every cell, the counters become the write cursors:
+	cellStart.resize(cellCount + 1);
+	uint32_t sum{ 0 };
+	for (size_t c = 0; c < cellCount; ++c) {
+		const uint32_t count = cellCounters[c].load(std::memory_order_relaxed);
+		cellStart[c] = sum;
+		cellCounters[c].store(sum, std::memory_order_relaxed);
+		sum += count;
+	}
+	cellStart[cellCount] = sum;
+
+	// pass 3: scatter the entities into their cells:
+	cellEntities.resize(sum);
+	JobSystem::parallelForChunks(entities.size(), chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				const uint32_t cell = entityCells[i];
+				if (cell != INVALID_CELL) {
+					cellEntities[cellCounters[cell].fetch_add(1, std::memory_order_relaxed)] = entities[i];
+				}
+			}
+		}
+	);
+
+	// pass 4: the scatter order within a cell depends on thread timing, sorting makes the querry results deterministic.
+	// The group masks are gathered in the same pass:
+	cellEntityGroupMasks.resize(sum);
+	cellGroupMask.resize(cellCount);
+	JobSystem::parallelFor(cellCount, MIN_ENTITIES_PER_CHUNK * 4,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t c = begin; c < end; ++c) {
+				if (cellStart[c + 1] - cellStart[c] > 1) {
+					std::sort(cellEntities.begin() + cellStart[c], cellEntities.begin() + cellStart[c + 1]);
+				}
+				CollisionMask groupMask = std::numeric_limits<CollisionMask>::max();
+				for (uint32_t i = cellStart[c]; i < cellStart[c + 1]; ++i) {
+					cellEntityGroupMasks[i] = world.getComp<Collider>(cellEntities[i]).groupMask;
+					groupMask &= cellEntityGroupMasks[i];
+				}
+				cellGroupMask[c] = groupMask;
+			}
+		}
+	);
+}
+
+void GridBroadphase::setupCells(size_t entityCount, float averageExtent, const Vec2 minPos, const Vec2 maxPos)
+{
+	cellSize = fixedCellSize > 0.0f ? fixedCellSize : std::max(averageExtent, 0.001f);
+
+	if (mode == Mode::Dense) {
+		const size_t maxCells = std::clamp(entityCount * DENSE_CELLS_PER_ENTITY, size_t(1), MAX_DENSE_CELLS);
+		const Vec2 extent = maxPos - minPos;
+		auto cellsFor = [&](float size) {
+			return (size_t(extent.x / size) + 1) * (size_t(extent.y / size) + 1);
+		};
+		while (cellsFor(cellSize) > maxCells) {
+			cellSize *= 2.0f;
+		}
+		origin = minPos;
+		dimX = int32_t(extent.x / cellSize) + 1;
+		dimY = int32_t(extent.y / cellSize) + 1;
+		cellCount = size_t(dimX) * size_t(dimY);
+	}
+	else {
+		origin = Vec2{ 0, 0 };
+		cellCount = 64;
+		while (cellCount < entityCount * 2) {
+			cellCount <<= 1;
+		}
+	}
+	invCellSize = 1.0f / cellSize;
+
+	if (cellCountersCapacity < cellCount) {
+		cellCounters = std::make_unique<std::atomic<uint32_t>[]>(cellCount);
+		cellCountersCapacity = cellCount;
+	}
+}
+
+void GridBroadphase::querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const
+{
+	if (cellEntities.empty()) return;
+
+	const Vec2 halfSize = qrySize * 0.5f + maxHalfExtent;
+	const int32_t minX = cellCoordX(qryPos.x - halfSize.x);
+	const int32_t minY = cellCoordY(qryPos.y - halfSize.y);
+	const int32_t maxX = cellCoordX(qryPos.x + halfSize.x);
+	const int32_t maxY = cellCoordY(qryPos.y + halfSize.y);
+
+	auto appendRange = [&](uint32_t begin, uint32_t end) {
+		if (ignoreGroupMask == 0) {
+			rVec.insert(rVec.end(), cellEntities.begin() + begin, cellEntities.begin() + end);
+			return;
+		}
+		for (uint32_t i = begin; i < end; ++i) {
+			if (cellEntityGroupMasks[i] & ignoreGroupMask) {
+				stats.culledEntities += 1;
+			}
+			else {
+				rVec.push_back(cellEntities[i]);
+			}
+		}
+	};
+	auto appendCell = [&](uint32_t cell) {
+		if (cellStart[cell + 1] == cellStart[cell]) return;
+		if (cellGroupMask[cell] & ignoreGroupMask) {
+			stats.culledNodes += 1;
+			return;
+		}
+		appendRange(cellStart[cell], cellStart[cell + 1]);
+	};
+
+	if (mode == Mode::Dense) {
+		// entities outside of the bounds are stored in the border cells, so the querry range is clamped, not cut:
+		for (int32_t y = std::clamp(minY, 0, dimY - 1); y <= std::clamp(maxY, 0, dimY - 1); ++y) {
+			for (int32_t x = std::clamp(minX, 0, dimX - 1); x <= std::clamp(maxX, 0, dimX - 1); ++x) {
+				appendCell(cellIndex(x, y));
+			}
+		}
+	}
+	else {
+		const size_t coveredCells = size_t(maxX - minX + 1) * size_t(maxY - minY + 1);
+		if (coveredCells >= cellCount) {
+			// the querry covers more cells than the table has buckets:
+			appendRange(0, uint32_t(cellEntities.size()));
+			return;
+		}
+		// different cell coordinates can hash to the same bucket, every bucket is only appended once:
+		thread_local std::vector<uint32_t> buckets;
+		buckets.clear();
+		for (int32_t y = minY; y <= maxY; ++y) {
+			for (int32_t x = minX; x <= maxX; ++x) {
+				buckets.push_back(cellIndex(x, y));
+			}
+		}
+		std::sort(buckets.begin(), buckets.end());
+		buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+		for (const uint32_t bucket : buckets) {
+			appendCell(bucket);
+		}
+	}
+}
+
+void GridBroadphase::querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const
+{
+	auto drawCell = [&](int32_t x, int32_t y) {
+		const Vec2 pos = origin + Vec2{ (float(x) + 0.5f) * cellSize, (float(y) + 0.5f) * cellSize };
+		draw.push_back(makeSprite(0, pos, 0.1f, Vec2{ cellSize, cellSize }, Vec4(0, 0, 0, 1), Form::Rectangle, RotaVec2(0)));
+		draw.push_back(makeSprite(0, pos, 0.11f, Vec2{ cellSize, cellSize } - Vec2(0.02f, 0.02f), color, Form::Rectangle, RotaVec2(0)));
+	};
+	if (mode == Mode::Dense) {
+		for (int32_t y = 0; y < dimY; ++y) {
+			for (int32_t x = 0; x < dimX; ++x) {
+				const uint32_t cell = cellIndex(x, y);
+				if (cellStart.size() > cell + 1 && cellStart[cell + 1] > cellStart[cell]) {
+					drawCell(x, y);
+				}
+			}
+		}
+	}
+	else {
+		for (const auto ent : cellEntities) {
+			const Vec2 pos = world.getComp<Transform>(ent).position;
+			drawCell(cellCoordX(pos.x), cellCoordY(pos.y));
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "CollisionUniform.hpp"
+#include "Broadphase.hpp"
+
+/**
+ * Uniform grid broadphase, rebuilt every frame with a parallel counting sort.
+ * Every entity is stored in exactly one cell, the one containing its position.
+ * Querries are enlarged by the biggest half aabb of all entities, so no overlap is missed,
+ * which makes the grid best suited for many colliders of similar size.
+ * In Dense mode, the cells cover the bounds given in update, this is the choice for bounded worlds.
+ * In Hashed mode, the cell coordinates are hashed into a table that scales with the entity count, so the world can be unbounded.
+ * Every cell stores the group mask bits shared by its entities, so masked querries skip whole cells.
+ */
+class GridBroadphase : public Broadphase {
+public:
+	enum class Mode : uint8_t {
+		Dense,
+		Hashed
+	};
+
+	static constexpr size_t MAX_DENSE_CELLS{ 1 << 20 };
+	static constexpr size_t DENSE_CELLS_PER_ENTITY{ 8 };	// limits the cell count for sparse worlds
+	static constexpr size_t MIN_ENTITIES_PER_CHUNK{ 512 };
+
+	/**
+	 * \param cellSize edge length of the cells, 0 chooses the average aabb extent of the entities each update.
+	 */
+	GridBroadphase(CollisionSECM world, uint8_t TAG = 0, Mode mode = Mode::Dense, float cellSize = 0.0f);
+
+	void update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos) override;
+
+	using Broadphase::querry;
+	void querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const override;
+
+	void querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const override;
+
+	float getCellSize() const { return cellSize; }
+	size_t getCellCount() const { return cellCount; }
+private:
+	static constexpr uint32_t INVALID_CELL{ 0xFFFFFFFF };
+
+	int32_t cellCoordX(float x) const { return int32_t(std::floor((x - origin.x) * invCellSize)); }
+	int32_t cellCoordY(float y) const { return int32_t(std::floor((y - origin.y) * invCellSize)); }
+	uint32_t cellIndex(int32_t x, int32_t y) const
+	{
+		if (mode == Mode::Dense) {
+			x = std::clamp(x, 0, dimX - 1);
+			y = std::clamp(y, 0, dimY - 1);
+			return uint32_t(y * dimX + x);
+		}
+		else {
+			return ((uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u)) & uint32_t(cellCount - 1);
+		}
+	}
+	void setupCells(size_t entityCount, float averageExtent, const Vec2 minPos, const Vec2 maxPos);
+
+	struct ExtentStats {
+		float extentSum{ 0.0f };
+		Vec2 maxHalfExtent{ 0, 0 };
+	};
+
+	CollisionSECM world;
+	Mode mode;
+	float fixedCellSize;
+
+	float cellSize{ 1.0f };
+	float invCellSize{ 1.0f };
+	Vec2 origin{ 0, 0 };
+	int32_t dimX{ 1 };
+	int32_t dimY{ 1 };
+	size_t cellCount{ 1 };
+	Vec2 maxHalfExtent{ 0, 0 };
+
+	std::vector<uint32_t> cellStart;				// cellCount + 1 entries, the entities of cell c are cellEntities[cellStart[c], cellStart[c+1])
+	std::vector<EntityHandleIndex> cellEntities;	// entities, sorted by cell and index
+	std::vector<CollisionMask> cellEntityGroupMasks;	// group masks of cellEntities
+	std::vector<CollisionMask> cellGroupMask;		// group bits shared by all entities of a cell, all bits for empty cells
+	std::vector<uint32_t> entityCells;				// cell of every entity in the update list
+	std::vector<ExtentStats> chunkStats;			// extents per update chunk, kept to not allocate every frame
+	std::unique_ptr<std::atomic<uint32_t>[]> cellCounters;
+	size_t cellCountersCapacity{ 0 };
+};
@@ -0,0 +1,224 @@
+#include "LinearQuadtree.hpp"
+
+LinearQuadtree::LinearQuadtree(CollisionSECM world, uint8_t TAG, size_t capacity) :
+	Broadphase{ TAG },
+	world{ world },
+	capacity{ std::max(capacity, size_t(1)) }
+{ }
+
+void LinearQuadtree::update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos)
+{
+	// the morton codes quantize the positions inside of the collider bounds to 16 bits per axis:
+	origin = minPos;
+	const float extent = std::max(maxPos.x - minPos.x, maxPos.y - minPos.y);
+	invCellSize = extent > 0.0f ? 65535.0f / extent : 0.0f;
+
+	// ignored entities get the biggest key, so they end up behind all others after sorting:
+	constexpr uint64_t IGNORED_KEY = std::numeric_limits<uint64_t>::max();
+	keys.resize(entities.size());
+	JobSystem::parallelFor(entities.size(), MIN_ENTITIES_PER_CHUNK,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				const auto ent = entities[i];
+				if (world.getComp<Collider>(ent).isIgnoredBy(COLLIDER_TAG)) {
+					keys[i] = IGNORED_KEY;
+				}
+				else {
+					keys[i] = (uint64_t(mortonCode(world.getComp<Transform>(ent).position)) << 32) | uint64_t(ent);
+				}
+			}
+		}
+	);
+	JobSystem::parallelSort(keys.begin(), keys.end(), std::less<uint64_t>(), MIN_ENTITIES_PER_CHUNK);
+	keys.erase(std::lower_bound(keys.begin(), keys.end(), IGNORED_KEY), keys.end());
+
+	sortedEntities.resize(keys.size());
+	sortedGroupMasks.resize(keys.size());
+	JobSystem::parallelFor(keys.size(), MIN_ENTITIES_PER_CHUNK,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				sortedEntities[i] = EntityHandleIndex(keys[i] & 0xFFFFFFFF);
+				sortedGroupMasks[i] = world.getComp<Collider>(sortedEntities[i]).groupMask;
+			}
+		}
+	);
+
+	buildNodes();
+	computeBounds(aabbs);
+}
+
+void LinearQuadtree::buildNodes()
+{
+	nodeFirstChild.assign(1, LEAF);
+	nodeBegin.assign(1, 0);
+	nodeEnd.assign(1, uint32_t(keys.size()));
+	levelStart = { 0, 1 };
+
+	for (uint32_t level = 0; level < MAX_LEVEL; ++level) {
+		const uint32_t levelBegin = levelStart[level];
+		const uint32_t levelEnd = levelStart[level + 1];
+
+		// the children of the split nodes are appended in node order, so their offsets are a running sum:
+		uint32_t next = levelEnd;
+		for (uint32_t node = levelBegin; node < levelEnd; ++node) {
+			if (nodeEnd[node] - nodeBegin[node] > capacity) {
+				nodeFirstChild[node] = next;
+				next += 4;
+			}
+		}
+		if (next == levelEnd) break;
+
+		nodeFirstChild.resize(next);
+		nodeBegin.resize(next);
+		nodeEnd.resize(next);
+		levelStart.push_back(next);
+
+		// the two code bits of this level select the child, the entities of a child are found by binary search:
+		const uint32_t shift = 30 - 2 * level;
+		const uint32_t prefixMask = level == 0 ? 0 : ~((1u << (shift + 2)) - 1);
+		JobSystem::parallelFor(levelEnd - levelBegin, MIN_NODES_PER_CHUNK,
+			[&](size_t begin, size_t end, uint32_t threadId) {
+				for (size_t i = begin; i < end; ++i) {
+					const uint32_t node = levelBegin + uint32_t(i);
+					const uint32_t firstChild = nodeFirstChild[node];
+					if (firstChild == LEAF) continue;
+
+					const uint32_t prefix = codeOf(keys[nodeBegin[node]]) & prefixMask;
+					uint32_t childBegin = nodeBegin[node];
+					for (uint32_t c = 0; c < 4; ++c) {
+						uint32_t childEnd = nodeEnd[node];
+						if (c < 3) {
+							const uint64_t nextChildKey = uint64_t(prefix | ((c + 1) << shift)) << 32;
+							childEnd = uint32_t(std::lower_bound(keys.begin() + childBegin, keys.begin() + nodeEnd[node], nextChildKey) - keys.begin());
+						}
+						nodeFirstChild[firstChild + c] = LEAF;
+						nodeBegin[firstChild + c] = childBegin;
+						nodeEnd[firstChild + c] = childEnd;
+						childBegin = childEnd;
+					}
+				}
+			}
+		);
+	}
+}
+
+void LinearQuadtree::computeBounds(const std::vector<Vec2>& aabbs)
+{
+	const size_t nodes = nodeBegin.size();
+	nodeMin.resize(nodes);
+	nodeMax.resize(nodes);
+	nodeGroupMask.resize(nodes);
+
+	// bottom up, the children of a level are allways on the next level:
+	for (size_t level = levelStart.size() - 1; level-- > 0;) {
+		const uint32_t levelBegin = levelStart[level];
+		JobSystem::parallelFor(levelStart[level + 1] - levelBegin, MIN_NODES_PER_CHUNK,
+			[&](size_t begin, size_t end, uint32_t threadId) {
+				for (size_t i = begin; i < end; ++i) {
+					const uint32_t node = levelBegin + uint32_t(i);
+					Vec2 min{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+					Vec2 max{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+					CollisionMask groupMask = std::numeric_limits<CollisionMask>::max();
+					if (nodeFirstChild[node] == LEAF) {
+						for (uint32_t e = nodeBegin[node]; e < nodeEnd[node]; ++e) {
+							const auto ent = sortedEntities[e];
+							const Vec2 pos = world.getComp<Transform>(ent).position;
+							min = ::min(min, pos - aabbs[ent] * 0.5f);
+							max = ::max(max, pos + aabbs[ent] * 0.5f);
+							groupMask &= sortedGroupMasks[e];
+						}
+					}
+					else {
+						for (uint32_t c = 0; c < 4; ++c) {
+							min = ::min(min, nodeMin[nodeFirstChild[node] + c]);
+							max = ::max(max, nodeMax[nodeFirstChild[node] + c]);
+							groupMask &= nodeGroupMask[nodeFirstChild[node] + c];
+						}
+					}
+					nodeMin[node] = min;
+					nodeMax[node] = max;
+					nodeGroupMask[node] = groupMask;
+				}
+			}
+		);
+	}
+
+	// gather the bounds of every four children:
+	childBounds.resize((nodes - 1) / 4);
+	JobSystem::parallelFor(childBounds.size(), MIN_NODES_PER_CHUNK,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t group = begin; group < end; ++group) {
+				ChildBounds& bounds = childBounds[group];
+				for (uint32_t c = 0; c < 4; ++c) {
+					const size_t node = 1 + group * 4 + c;
+					bounds.minX[c] = nodeMin[node].x;
+					bounds.minY[c] = nodeMin[node].y;
+					bounds.maxX[c] = nodeMax[node].x;
+					bounds.maxY[c] = nodeMax[node].y;
+				}
+			}
+		}
+	);
+}
+
+void LinearQuadtree::querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const
+{
+	if (sortedEntities.empty()) return;
+
+	const Vec2 qryMin = qryPos - qrySize * 0.5f;
+	const Vec2 qryMax = qryPos + qrySize * 0.5f;
+	if (nodeMin[0].x > qryMax.x || nodeMax[0].x < qryMin.x || nodeMin[0].y > qryMax.y || nodeMax[0].y < qryMin.y) return;
+
+	// the stack is kept per thread, so that querries do not allocate:
+	thread_local std::vector<uint32_t> stack;
+	stack.clear();
+	stack.push_back(0);
+
+	while (!stack.empty()) {
+		const uint32_t node = stack.back();
+		stack.pop_back();
+
+		if (nodeGroupMask[node] & ignoreGroupMask) {
+			stats.culledNodes += 1;
+			continue;
+		}
+
+		const uint32_t firstChild = nodeFirstChild[node];
+		if (firstChild == LEAF) {
+			if (ignoreGroupMask == 0) {
+				rVec.insert(rVec.end(), sortedEntities.begin() + nodeBegin[node], sortedEntities.begin() + nodeEnd[node]);
+			}
+			else {
+				for (uint32_t e = nodeBegin[node]; e < nodeEnd[node]; ++e) {
+					if (sortedGroupMasks[e] & ignoreGroupMask) {
+						stats.culledEntities += 1;
+					}
+					else {
+						rVec.push_back(sortedEntities[e]);
+					}
+				}
+			}
+		}
+		else {
+			// empty children have inverted bounds and never overlap:
+			const uint32_t mask = overlapMask(childBounds[(firstChild - 1) / 4], qryMin, qryMax);
+			for (uint32_t c = 0; c < 4; ++c) {
+				if (mask & (1u << c)) {
+					stack.push_back(firstChild + c);
+				}
+			}
+		}
+	}
+}
+
+void LinearQuadtree::querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const
+{
+	for (size_t node = 0; node < nodeBegin.size(); ++node) {
+		if (nodeFirstChild[node] == LEAF && nodeEnd[node] > nodeBegin[node]) {
+			const Vec2 pos = (nodeMin[node] + nodeMax[node]) * 0.5f;
+			const Vec2 size = nodeMax[node] - nodeMin[node];
+			draw.push_back(makeSprite(0, pos, 0.1f, size, Vec4(0, 0, 0, 1), Form::Rectangle, RotaVec2(0)));
+			draw.push_back(makeSprite(0, pos, 0.11f, size - Vec2(0.02f, 0.02f), color, Form::Rectangle, RotaVec2(0)));
+		}
+	}
+}
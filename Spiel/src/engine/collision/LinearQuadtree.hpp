@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LINEAR_QUADTREE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "CollisionUniform.hpp"
+#include "Broadphase.hpp"
+
+/**
+ * Pointer free quadtree that is rebuilt every frame.
+ * The entities are sorted by the morton code of their position, so every node is a contiguous range of the sorted entities.
+ * Nodes are built level by level in parallel and stored in flat arrays, the four children of a node are allways adjacent.
+ * Every node stores the bounds of the aabbs it contains, so entities can not be missed by querries, no matter how big they are.
+ * The bounds of the four children of a node are stored together, so they are tested against a querry in one go.
+ * Every node also stores the group mask bits shared by all of its entities, so masked querries skip whole subtrees.
+ */
+class LinearQuadtree : public Broadphase {
+public:
+	static constexpr size_t DEFAULT_CAPACITY{ 6 };
+	static constexpr size_t MIN_ENTITIES_PER_CHUNK{ 1024 };
+	static constexpr size_t MIN_NODES_PER_CHUNK{ 256 };
+	static constexpr uint32_t MAX_LEVEL{ 16 };	// 16 bits per axis in the 32 bit morton codes
+
+	/**
+	 * \param capacity nodes with more entities are split.
+	 */
+	LinearQuadtree(CollisionSECM world, uint8_t TAG = 0, size_t capacity = DEFAULT_CAPACITY);
+
+	void update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos) override;
+
+	using Broadphase::querry;
+	void querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const override;
+
+	void querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const override;
+
+	size_t size() const { return sortedEntities.size(); }
+	size_t nodeCount() const { return nodeBegin.size(); }
+private:
+	static constexpr uint32_t LEAF{ 0 };	// the root is never a child, so 0 can mark a missing child offset
+
+	/**
+	 * bounds of the four children of a node, ordered to be tested at once.
+	 */
+	struct alignas(16) ChildBounds {
+		float minX[4];
+		float minY[4];
+		float maxX[4];
+		float maxY[4];
+	};
+
+	static uint32_t spreadBits(uint32_t x)
+	{
+		x &= 0x0000FFFF;
+		x = (x | (x << 8)) & 0x00FF00FF;
+		x = (x | (x << 4)) & 0x0F0F0F0F;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+		return x;
+	}
+	uint32_t mortonCode(const Vec2 pos) const
+	{
+		const Vec2 cell = (pos - origin) * invCellSize;
+		const uint32_t x = uint32_t(std::clamp(cell.x, 0.0f, 65535.0f));
+		const uint32_t y = uint32_t(std::clamp(cell.y, 0.0f, 65535.0f));
+		return (spreadBits(y) << 1) | spreadBits(x);
+	}
+	static uint32_t codeOf(uint64_t key) { return uint32_t(key >> 32); }
+
+	/**
+	 * \return bit i is set, if child i overlaps with the querry box.
+	 */
+	static uint32_t overlapMask(const ChildBounds& children, const Vec2 qryMin, const Vec2 qryMax)
+	{
+#ifdef LINEAR_QUADTREE_SSE2
+		const __m128 overlapsX = _mm_and_ps(
+			_mm_cmple_ps(_mm_load_ps(children.minX), _mm_set1_ps(qryMax.x)),
+			_mm_cmpge_ps(_mm_load_ps(children.maxX), _mm_set1_ps(qryMin.x)));
+		const __m128 overlapsY = _mm_and_ps(
+			_mm_cmple_ps(_mm_load_ps(children.minY), _mm_set1_ps(qryMax.y)),
+			_mm_cmpge_ps(_mm_load_ps(children.maxY), _mm_set1_ps(qryMin.y)));
+		return uint32_t(_mm_movemask_ps(_mm_and_ps(overlapsX, overlapsY)));
+#else
+		uint32_t mask{ 0 };
+		for (uint32_t i = 0; i < 4; ++i) {
+			const bool overlaps =
+				children.minX[i] <= qryMax.x && children.maxX[i] >= qryMin.x &&
+				children.minY[i] <= qryMax.y && children.maxY[i] >= qryMin.y;
+			mask |= uint32_t(overlaps) << i;
+		}
+		return mask;
+#endif
+	}
+
+	void buildNodes();
+	void computeBounds(const std::vector<Vec2>& aabbs);
+
+	CollisionSECM world;
+	size_t capacity;
+
+	Vec2 origin{ 0, 0 };
+	float invCellSize{ 1.0f };
+
+	std::vector<uint64_t> keys;							// morton code << 32 | entity, sorted
+	std::vector<EntityHandleIndex> sortedEntities;		// entities in morton order, every node is a range of it
+	std::vector<CollisionMask> sortedGroupMasks;		// group masks of sortedEntities
+	std::vector<uint32_t> levelStart;					// first node of every level, plus the node count
+	// nodes:
+	std::vector<uint32_t> nodeFirstChild;				// the four children are adjacent, LEAF for leafes
+	std::vector<uint32_t> nodeBegin;					// range in sortedEntities
+	std::vector<uint32_t> nodeEnd;
+	std::vector<Vec2> nodeMin;							// bounds of the aabbs in the node
+	std::vector<Vec2> nodeMax;
+	std::vector<CollisionMask> nodeGroupMask;			// group bits shared by all entities in the node, all bits for empty nodes
+	std::vector<ChildBounds> childBounds;				// children of node n are at (nodeFirstChild[n] - 1) / 4
+};
@@ -0,0 +1,194 @@
+#include "NarrowphaseKernels.hpp"
+
+#include <bit>
+#include <cmath>
+#include <algorithm>
+
+#if defined(NARROWPHASE_AVX2)
+#include <immintrin.h>
+#elif defined(NARROWPHASE_SSE)
+#include <emmintrin.h>
+#endif
+
+/*
+	The kernels are written once against a small lane interface and instanciated for every instruction set.
+	A lane type provides WIDTH, load, set, arithmetic operators, min, max, abs
+	and comparisons that return a bitmask with one bit per lane.
+*/
+namespace {
+
+struct ScalarLanes {
+	static constexpr size_t WIDTH{ 1 };
+	static ScalarLanes load(const float* p) { return { *p }; }
+	static ScalarLanes set(float f) { return { f }; }
+	float v;
+};
+inline ScalarLanes operator+(ScalarLanes a, ScalarLanes b) { return { a.v + b.v }; }
+inline ScalarLanes operator-(ScalarLanes a, ScalarLanes b) { return { a.v - b.v }; }
+inline ScalarLanes operator*(ScalarLanes a, ScalarLanes b) { return { a.v * b.v }; }
+inline ScalarLanes min(ScalarLanes a, ScalarLanes b) { return { std::min(a.v, b.v) }; }
+inline ScalarLanes max(ScalarLanes a, ScalarLanes b) { return { std::max(a.v, b.v) }; }
+inline ScalarLanes abs(ScalarLanes a) { return { std::fabs(a.v) }; }
+inline uint32_t lessMask(ScalarLanes a, ScalarLanes b) { return uint32_t(a.v < b.v); }
+inline uint32_t lessEqualMask(ScalarLanes a, ScalarLanes b) { return uint32_t(a.v <= b.v); }
+
+#if defined(NARROWPHASE_SSE)
+struct SSELanes {
+	static constexpr size_t WIDTH{ 4 };
+	static SSELanes load(const float* p) { return { _mm_loadu_ps(p) }; }
+	static SSELanes set(float f) { return { _mm_set1_ps(f) }; }
+	__m128 v;
+};
+inline SSELanes operator+(SSELanes a, SSELanes b) { return { _mm_add_ps(a.v, b.v) }; }
+inline SSELanes operator-(SSELanes a, SSELanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline SSELanes operator*(SSELanes a, SSELanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline SSELanes min(SSELanes a, SSELanes b) { return { _mm_min_ps(a.v, b.v) }; }
+inline SSELanes max(SSELanes a, SSELanes b) { return { _mm_max_ps(a.v, b.v) }; }
+inline SSELanes abs(SSELanes a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+inline uint32_t lessMask(SSELanes a, SSELanes b) { return uint32_t(_mm_movemask_ps(_mm_cmplt_ps(a.v, b.v))); }
+inline uint32_t lessEqualMask(SSELanes a, SSELanes b) { return uint32_t(_mm_movemask_ps(_mm_cmple_ps(a.v, b.v))); }
+#endif
+
+#if defined(NARROWPHASE_AVX2)
+struct AVX2Lanes {
+	static constexpr size_t WIDTH{ 8 };
+	static AVX2Lanes load(const float* p) { return { _mm256_loadu_ps(p) }; }
+	static AVX2Lanes set(float f) { return { _mm256_set1_ps(f) }; }
+	__m256 v;
+};
+inline AVX2Lanes operator+(AVX2Lanes a, AVX2Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline AVX2Lanes operator-(AVX2Lanes a, AVX2Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline AVX2Lanes operator*(AVX2Lanes a, AVX2Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline AVX2Lanes min(AVX2Lanes a, AVX2Lanes b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline AVX2Lanes max(AVX2Lanes a, AVX2Lanes b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline AVX2Lanes abs(AVX2Lanes a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+inline uint32_t lessMask(AVX2Lanes a, AVX2Lanes b) { return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ))); }
+inline uint32_t lessEqualMask(AVX2Lanes a, AVX2Lanes b) { return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ))); }
+#endif
+
+/**
+ * writes base + index of every set bit of the mask to out.
+ * \return count of written indices.
+ */
+inline size_t writeIndices(uint32_t mask, size_t base, uint32_t* out)
+{
+	size_t count{ 0 };
+	while (mask) {
+		out[count++] = uint32_t(base + std::countr_zero(mask));
+		mask &= mask - 1;
+	}
+	return count;
+}
+
+template<typename Lanes>
+size_t overlapCircleCircle(Lanes, const ShapePairBatch& batch, size_t begin, size_t end, uint32_t* overlapping)
+{
+	size_t count{ 0 };
+	const Lanes half = Lanes::set(0.5f);
+	for (size_t i = begin; i < end; i += Lanes::WIDTH) {
+		const Lanes dx = Lanes::load(&batch.bPosX[i]) - Lanes::load(&batch.aPosX[i]);
+		const Lanes dy = Lanes::load(&batch.bPosY[i]) - Lanes::load(&batch.aPosY[i]);
+		const Lanes radius = (Lanes::load(&batch.aSizeX[i]) + Lanes::load(&batch.bSizeX[i])) * half;
+		count += writeIndices(lessMask(dx * dx + dy * dy, radius * radius), i, overlapping + count);
+	}
+	return count;
+}
+
+template<typename Lanes>
+size_t overlapCircleRectangle(Lanes, const ShapePairBatch& batch, size_t begin, size_t end, uint32_t* overlapping)
+{
+	size_t count{ 0 };
+	const Lanes half = Lanes::set(0.5f);
+	const Lanes zero = Lanes::set(0.0f);
+	for (size_t i = begin; i < end; i += Lanes::WIDTH) {
+		// circle center in the space of the rectangle:
+		const Lanes dx = Lanes::load(&batch.aPosX[i]) - Lanes::load(&batch.bPosX[i]);
+		const Lanes dy = Lanes::load(&batch.aPosY[i]) - Lanes::load(&batch.bPosY[i]);
+		const Lanes cos = Lanes::load(&batch.bCos[i]);
+		const Lanes sin = Lanes::load(&batch.bSin[i]);
+		const Lanes localX = dx * cos + dy * sin;
+		const Lanes localY = dy * cos - dx * sin;
+		// distance to the nearest point of the rectangle, 0 if the center is inside:
+		const Lanes halfX = Lanes::load(&batch.bSizeX[i]) * half;
+		const Lanes halfY = Lanes::load(&batch.bSizeY[i]) * half;
+		const Lanes offX = localX - max(zero - halfX, min(localX, halfX));
+		const Lanes offY = localY - max(zero - halfY, min(localY, halfY));
+		const Lanes radius = Lanes::load(&batch.aSizeX[i]) * half;
+		count += writeIndices(lessMask(offX * offX + offY * offY, radius * radius), i, overlapping + count);
+	}
+	return count;
+}
+
+template<typename Lanes>
+size_t overlapRectangleRectangle(Lanes, const ShapePairBatch& batch, size_t begin, size_t end, uint32_t* overlapping)
+{
+	size_t count{ 0 };
+	const Lanes half = Lanes::set(0.5f);
+	for (size_t i = begin; i < end; i += Lanes::WIDTH) {
+		const Lanes dx = Lanes::load(&batch.bPosX[i]) - Lanes::load(&batch.aPosX[i]);
+		const Lanes dy = Lanes::load(&batch.bPosY[i]) - Lanes::load(&batch.aPosY[i]);
+		const Lanes cosA = Lanes::load(&batch.aCos[i]);
+		const Lanes sinA = Lanes::load(&batch.aSin[i]);
+		const Lanes cosB = Lanes::load(&batch.bCos[i]);
+		const Lanes sinB = Lanes::load(&batch.bSin[i]);
+		const Lanes halfAX = Lanes::load(&batch.aSizeX[i]) * half;
+		const Lanes halfAY = Lanes::load(&batch.aSizeY[i]) * half;
+		const Lanes halfBX = Lanes::load(&batch.bSizeX[i]) * half;
+		const Lanes halfBY = Lanes::load(&batch.bSizeY[i]) * half;
+		// |cos| and |sin| of the angle between the rectangles are the absolute dot products of their axes:
+		const Lanes c = abs(cosA * cosB + sinA * sinB);
+		const Lanes s = abs(sinA * cosB - cosA * sinB);
+		// the rectangles overlap, if the center distance projected on every axis is at most the sum of the projected half sizes:
+		const uint32_t mask =
+			lessEqualMask(abs(dx * cosA + dy * sinA), halfAX + halfBX * c + halfBY * s) &
+			lessEqualMask(abs(dy * cosA - dx * sinA), halfAY + halfBX * s + halfBY * c) &
+			lessEqualMask(abs(dx * cosB + dy * sinB), halfBX + halfAX * c + halfAY * s) &
+			lessEqualMask(abs(dy * cosB - dx * sinB), halfBY + halfAX * s + halfAY * c);
+		count += writeIndices(mask, i, overlapping + count);
+	}
+	return count;
+}
+
+/**
+ * runs the kernel with the widest allowed lanes first, the rest of the batch is processed by the narrower lanes.
+ */
+template<typename Kernel>
+size_t runKernel(const ShapePairBatch& batch, uint32_t* overlapping, SimdLevel level, Kernel&& kernel)
+{
+	size_t begin{ 0 };
+	size_t count{ 0 };
+	auto runLanes = [&](auto lanes) {
+		using Lanes = decltype(lanes);
+		const size_t end = begin + (batch.size() - begin) / Lanes::WIDTH * Lanes::WIDTH;
+		count += kernel(lanes, begin, end, overlapping + count);
+		begin = end;
+	};
+#if defined(NARROWPHASE_AVX2)
+	if (level >= SimdLevel::AVX2) runLanes(AVX2Lanes{});
+#endif
+#if defined(NARROWPHASE_SSE)
+	if (level >= SimdLevel::SSE) runLanes(SSELanes{});
+#endif
+	runLanes(ScalarLanes{});
+	return count;
+}
+
+}
+
+size_t batchOverlapCircleCircle(const ShapePairBatch& batch, uint32_t* overlapping, SimdLevel level)
+{
+	return runKernel(batch, overlapping, level,
+		[&](auto lanes, size_t begin, size_t end, uint32_t* out) { return overlapCircleCircle(lanes, batch, begin, end, out); });
+}
+
+size_t batchOverlapCircleRectangle(const ShapePairBatch& batch, uint32_t* overlapping, SimdLevel level)
+{
+	return runKernel(batch, overlapping, level,
+		[&](auto lanes, size_t begin, size_t end, uint32_t* out) { return overlapCircleRectangle(lanes, batch, begin, end, out); });
+}
+
+size_t batchOverlapRectangleRectangle(const ShapePairBatch& batch, uint32_t* overlapping, SimdLevel level)
+{
+	return runKernel(batch, overlapping, level,
+		[&](auto lanes, size_t begin, size_t end, uint32_t* out) { return overlapRectangleRectangle(lanes, batch, begin, end, out); });
+}
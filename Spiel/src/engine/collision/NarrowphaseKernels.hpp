@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "../../engine/types/BaseTypes.hpp"
+#include "../../engine/math/Vec2.hpp"
+
+/*
+	The instruction set of the batched narrowphase kernels is chosen at compile time.
+	Release x64 builds with /arch:AVX2, define NARROWPHASE_FORCE_SCALAR to use the scalar reference kernels everywhere.
+*/
+#if !defined(NARROWPHASE_FORCE_SCALAR)
+#if defined(__AVX2__)
+#define NARROWPHASE_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NARROWPHASE_SSE
+#endif
+#endif
+
+enum class SimdLevel : uint8_t {
+	Scalar,
+	SSE,
+	AVX2
+};
+
+#if defined(NARROWPHASE_AVX2)
+static constexpr SimdLevel BEST_SIMD_LEVEL{ SimdLevel::AVX2 };
+#elif defined(NARROWPHASE_SSE)
+static constexpr SimdLevel BEST_SIMD_LEVEL{ SimdLevel::SSE };
+#else
+static constexpr SimdLevel BEST_SIMD_LEVEL{ SimdLevel::Scalar };
+#endif
+
+/**
+ * Candidate pairs of single shape colliders in structure of arrays layout, so the kernels can load several pairs at once.
+ * Pair i consists of the shape a and b at index i of the arrays.
+ * The buffers keep their capacity on clear, so a batch that is reused every frame does not allocate.
+ */
+struct ShapePairBatch {
+	void clear()
+	{
+		for (auto* array : { &aPosX, &aPosY, &aSizeX, &aSizeY, &aCos, &aSin, &bPosX, &bPosY, &bSizeX, &bSizeY, &bCos, &bSin }) {
+			array->clear();
+		}
+		ids.clear();
+	}
+
+	/**
+	 * \param id user data to identify the pair after the overlap test.
+	 */
+	void push(uint32_t id, Vec2 posA, Vec2 sizeA, RotaVec2 rotaA, Vec2 posB, Vec2 sizeB, RotaVec2 rotaB)
+	{
+		ids.push_back(id);
+		aPosX.push_back(posA.x);	aPosY.push_back(posA.y);
+		aSizeX.push_back(sizeA.x);	aSizeY.push_back(sizeA.y);
+		aCos.push_back(rotaA.cos);	aSin.push_back(rotaA.sin);
+		bPosX.push_back(posB.x);	bPosY.push_back(posB.y);
+		bSizeX.push_back(sizeB.x);	bSizeY.push_back(sizeB.y);
+		bCos.push_back(rotaB.cos);	bSin.push_back(rotaB.sin);
+	}
+
+	size_t size() const { return ids.size(); }
+
+	std::vector<uint32_t> ids;
+	std::vector<float> aPosX, aPosY, aSizeX, aSizeY, aCos, aSin;
+	std::vector<float> bPosX, bPosY, bSizeX, bSizeY, bCos, bSin;
+};
+
+/*
+	The batched overlap tests write the indices of the overlapping pairs of the batch to overlapping, in increasing order.
+	overlapping must have room for batch.size() indices.
+	They only decide if the shapes overlap, the collision manifold is generated by the scalar collision tests afterwards.
+	Requesting a SimdLevel that was not compiled in uses the best available one below it.
+	All levels give the same result, the scalar level is the reference for testing.
+*/
+
+/**
+ * both shapes are circles, size.x is the diameter.
+ * \return count of overlapping pairs.
+ */
+size_t batchOverlapCircleCircle(const ShapePairBatch& batch, uint32_t* overlapping, SimdLevel level = BEST_SIMD_LEVEL);
+
+/**
+ * a is a circle, b is a rectangle.
+ * \return count of overlapping pairs.
+ */
+size_t batchOverlapCircleRectangle(const ShapePairBatch& batch, uint32_t* overlapping, SimdLevel level = BEST_SIMD_LEVEL);
+
+/**
+ * both shapes are rectangles, tested with the separating axis theorem on the four rectangle axes.
+ * \return count of overlapping pairs.
+ */
+size_t batchOverlapRectangleRectangle(const ShapePairBatch& batch, uint32_t* overlapping, SimdLevel level = BEST_SIMD_LEVEL);
@@ -1,11 +1,11 @@
 #include "QuadTree.hpp"
 
 Quadtree::Quadtree(const Vec2 minPos_, const Vec2 maxPos_, const size_t capacity_, CollisionSECM wrld, uint8_t TAG) :
+	Broadphase{ TAG },
 	m_pos{ (maxPos_ - minPos_) / 2 + minPos_ },
 	m_size{ maxPos_ - minPos_ },
 	m_capacity{ capacity_ },
-	world{ wrld },
-	COLLIDER_TAG{ TAG }
+	world{ wrld }
 {
 	root.firstSubTree = nodes.make4Children();
 }
@@ -307,14 +307,79 @@ void Quadtree::querry(std::vector<EntityHandleIndex>& rVec, const Vec2 qryPos, c
 	}
 }
 
-void Quadtree::querry(std::vector<EntityHandleIndex>& rVec, std::vector<QtreeNodeQuerry>& frontier, const Vec2 qryPos, const Vec2 qrySize) const
+void Quadtree::update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos)
+{
+	resetPerMinMax(minPos, maxPos);
+	removeEmptyLeafes();
+	broadInsert(entities, aabbs);
+
+	// the four subtrees of the root are independent:
+	JobSystem::parallelFor(4, 1,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				updateGroupMasks(nodes.get(root.firstSubTree + uint32_t(i)));
+			}
+		}
+	);
+	root.sharedGroupMask = std::numeric_limits<CollisionMask>::max();
+	for (const auto ent : root.collidables) {
+		root.sharedGroupMask &= world.getComp<Collider>(ent).groupMask;
+	}
+	for (uint32_t i = 0; i < 4; ++i) {
+		root.sharedGroupMask &= nodes.get(root.firstSubTree + i).sharedGroupMask;
+	}
+}
+
+CollisionMask Quadtree::updateGroupMasks(QuadtreeNode& node)
+{
+	CollisionMask groupMask = std::numeric_limits<CollisionMask>::max();
+	for (const auto ent : node.collidables) {
+		groupMask &= world.getComp<Collider>(ent).groupMask;
+	}
+	if (node.hasSubTrees()) {
+		for (uint32_t i = 0; i < 4; ++i) {
+			groupMask &= updateGroupMasks(nodes.get(node.firstSubTree + i));
+		}
+	}
+	node.sharedGroupMask = groupMask;
+	return groupMask;
+}
+
+void Quadtree::appendCollidables(FrameVector<EntityHandleIndex>& rVec, const QuadtreeNode& node, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const
+{
+	if (ignoreGroupMask == 0) {
+		rVec.insert(rVec.end(), node.collidables.begin(), node.collidables.end());
+		return;
+	}
+	for (const auto ent : node.collidables) {
+		if (world.getComp<Collider>(ent).groupMask & ignoreGroupMask) {
+			stats.culledEntities += 1;
+		}
+		else {
+			rVec.push_back(ent);
+		}
+	}
+}
+
+void Quadtree::querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const
+{
+	// the frontier is kept per thread, so that querries do not allocate:
+	thread_local std::vector<QtreeNodeQuerry> frontier;
+	querry(rVec, frontier, qryPos, qrySize, ignoreGroupMask, stats);
+}
+
+void Quadtree::querry(FrameVector<EntityHandleIndex>& rVec, std::vector<QtreeNodeQuerry>& frontier, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const
 {
 	frontier.clear();
 	if (frontier.capacity() < 20)
 		frontier.reserve(20);
+
+	if (root.sharedGroupMask & ignoreGroupMask) {
+		stats.culledNodes += 1;
+		return;
+	}
 	
-	for (const auto ent : root.collidables)
-		rVec.push_back(ent);
+	appendCollidables(rVec, root, ignoreGroupMask, stats);
 	auto [isInUl, isInUr, isInDl, isInDr] = isInSubtrees(m_pos, m_size, qryPos, qrySize);
 	if (isInUl) {
 		frontier.push_back({ root.firstSubTree + 0, m_pos + Vec2(-m_size.x, -m_size.y) * 0.25f, m_size * 0.5000001f });
@@ -333,9 +398,11 @@ void Quadtree::querry(std::vector<EntityHandleIndex>& rVec, std::vector<QtreeNod
 		QtreeNodeQuerry querry = frontier.back();
 		frontier.pop_back();
 		const auto& node = nodes.get(querry.nodeId);
-		for (const auto ent : node.collidables) {
-			rVec.push_back(ent);
+		if (node.sharedGroupMask & ignoreGroupMask) {
+			stats.culledNodes += 1;
+			continue;
 		}
+		appendCollidables(rVec, node, ignoreGroupMask, stats);
 	
 		if (node.hasSubTrees()) {
 			auto [isInUl, isInUr, isInDl, isInDr] = isInSubtrees(querry.pos, querry.size, qryPos, qrySize);
@@ -4,6 +4,7 @@
 #include <vector>
 #include <array>
 #include <mutex>
+#include <limits>
 
 #include "../../engine/types/BaseTypes.hpp"
 #include "../../engine/rendering/Sprite.hpp"
@@ -11,6 +12,7 @@
 #include "../collision/collision_detection.hpp"
 
 #include "CollisionUniform.hpp"
+#include "Broadphase.hpp"
 
 struct QtreeNodeQuerry {
 	uint32_t nodeId;
@@ -28,6 +30,7 @@ struct QuadtreeNode {
 
 	std::vector<uint32_t> collidables;
 	uint32_t firstSubTree{ INVALID_ID };
+	CollisionMask sharedGroupMask{ 0 };	// group bits shared by all entities in the node and its subtrees
 };
 
 class NodeStorage {
@@ -135,7 +138,7 @@ private:
 }; 
 
 
-class Quadtree {
+class Quadtree : public Broadphase {
 public:
 	Quadtree(const Vec2 minPos_, const Vec2 maxPos_, const size_t capacity_, CollisionSECM wrld, uint8_t TAG = 0);
 
@@ -148,12 +151,18 @@ public:
 
 	void broadInsert(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs);
 
-	void querry(std::vector<EntityHandleIndex>& rVec, std::vector<QtreeNodeQuerry>& buffer, const Vec2 qryPos, const Vec2 qrySize) const;
+	/**
+	 * clears the tree and inserts all given entities again.
+	 */
+	void update(const std::vector<EntityHandleIndex>& entities, const std::vector<Vec2>& aabbs, const Vec2 minPos, const Vec2 maxPos) override;
+
+	using Broadphase::querry;
+	void querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const override;
 
 	void querryDebug(const Vec2 qryPos, const Vec2 qrySize, std::vector<Sprite>& draw) const {
 		querryDebug(qryPos, qrySize, 0, m_pos, m_size, draw, 0);
 	}
-	void querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const {
+	void querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const override {
 		querryDebugAll(0, m_pos, m_size, draw, color, 0);
 	}
 
@@ -185,13 +194,21 @@ public:
 
 	Vec2 getPosition() const { return m_pos; }
 	Vec2 getSize() const { return m_size; }
-
-	const uint8_t COLLIDER_TAG;
 private:
 
 	void insert(const uint32_t ent, const std::vector<Vec2>& aabbs, const uint32_t thisID, const Vec2 thisPos, const Vec2 thisSize, const int depth);
 	void broadInsert(std::vector<uint32_t>&& entities, const std::vector<Vec2>& aabbs, const uint32_t thisID, const Vec2 thisPos, const Vec2 thisSize, const int depth);
 	void querry(std::vector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, const uint32_t thisID, const Vec2 thisPos, const Vec2 thisSize) const;
+	void querry(FrameVector<EntityHandleIndex>& rVec, std::vector<QtreeNodeQuerry>& frontier, const Vec2 qryPos, const Vec2 qrySize, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const;
+	/**
+	 * appends the collidables of the node to rVec, except the ones whose group mask intersects ignoreGroupMask.
+	 */
+	void appendCollidables(FrameVector<EntityHandleIndex>& rVec, const QuadtreeNode& node, const CollisionMask ignoreGroupMask, BroadphaseQuerryStats& stats) const;
+	/**
+	 * recomputes the shared group masks of the node and its subtrees.
+	 * \return the shared group mask of the node.
+	 */
+	CollisionMask updateGroupMasks(QuadtreeNode& node);
 	void querryDebug(const Vec2 qryPos, const Vec2 qrySize, const uint32_t thisID, const Vec2 thisPos, const Vec2 thisSize, std::vector<Sprite>& draw, int depth) const;
 	void querryDebugAll(const uint32_t thisID, const Vec2 thisPos, const Vec2 thisSize, std::vector<Sprite>& draw, const Vec4 color, const int depth) const;
 
@@ -0,0 +1,137 @@
+#include "StaticSDF.hpp"
+
+namespace {
+
+/**
+ * \return signed distance of the point to the shape, negative inside.
+ */
+float shapeDistance(Vec2 point, Vec2 pos, Vec2 size, Form form, RotaVec2 rota)
+{
+	if (form == Form::Circle) {
+		return length(point - pos) - size.x * 0.5f;
+	}
+	const Vec2 local = rotateInverse(point - pos, rota);
+	const Vec2 q = abs(local) - size * 0.5f;
+	const float outside = length(max(q, Vec2{ 0, 0 }));
+	const float inside = std::min(std::max(q.x, q.y), 0.0f);
+	return outside + inside;
+}
+
+}
+
+StaticSDF::StaticSDF(float cellSize, float band) :
+	baseCellSize{ cellSize },
+	cellSize{ cellSize },
+	band{ band }
+{ }
+
+void StaticSDF::bake(CollisionSECM world, const std::vector<EntityHandleIndex>& statics, const std::vector<Vec2>& aabbs)
+{
+	bakeCount += 1;
+	groupMaskUnion = 0;
+	if (statics.empty()) {
+		dimX = 0;
+		dimY = 0;
+		distances.clear();
+		nearest.clear();
+		return;
+	}
+
+	Vec2 minPos{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	Vec2 maxPos{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+	for (const auto ent : statics) {
+		if (world.getComp<Collider>(ent).isIgnoredBy(Collider::STATIC)) continue;
+		const Vec2 pos = world.getComp<Transform>(ent).position;
+		minPos = min(minPos, pos - aabbs[ent] * 0.5f);
+		maxPos = max(maxPos, pos + aabbs[ent] * 0.5f);
+		groupMaskUnion |= world.getComp<Collider>(ent).groupMask;
+	}
+	minPos -= Vec2{ band, band };
+	maxPos += Vec2{ band, band };
+
+	const Vec2 extent = maxPos - minPos;
+	cellSize = baseCellSize;
+	while ((size_t(extent.x / cellSize) + 2) * (size_t(extent.y / cellSize) + 2) > MAX_SAMPLES) {
+		cellSize *= 2.0f;
+	}
+	origin = minPos;
+	dimX = int32_t(extent.x / cellSize) + 2;
+	dimY = int32_t(extent.y / cellSize) + 2;
+	distances.assign(size_t(dimX) * dimY, band);
+	nearest.assign(size_t(dimX) * dimY, INVALID_ENTITY_HANDLE_INDEX);
+
+	// every chunk of rows stamps the shapes that reach into it, so no sample is written by two jobs:
+	const size_t chunks = JobSystem::chunkCount(size_t(dimY), MIN_ROWS_PER_CHUNK);
+	JobSystem::parallelForChunks(size_t(dimY), chunks,
+		[&](size_t chunk, size_t rowBegin, size_t rowEnd, uint32_t threadId) {
+			for (const auto ent : statics) {
+				const Transform& transform = world.getComp<Transform>(ent);
+				const Collider& collider = world.getComp<Collider>(ent);
+				if (collider.isIgnoredBy(Collider::STATIC)) continue;
+				const Vec2 reach = aabbs[ent] * 0.5f + Vec2{ band, band };
+				const Vec2 low = (transform.position - reach - origin) * (1.0f / cellSize);
+				const Vec2 high = (transform.position + reach - origin) * (1.0f / cellSize);
+				const int32_t y0 = std::max(int32_t(rowBegin), int32_t(std::floor(low.y)));
+				const int32_t y1 = std::min(int32_t(rowEnd) - 1, int32_t(std::ceil(high.y)));
+				const int32_t x0 = std::max(0, int32_t(std::floor(low.x)));
+				const int32_t x1 = std::min(dimX - 1, int32_t(std::ceil(high.x)));
+				const auto extraColliders = collider.extraColliders();
+
+				for (int32_t y = y0; y <= y1; ++y) {
+					for (int32_t x = x0; x <= x1; ++x) {
+						const Vec2 point = origin + Vec2{ float(x), float(y) } * cellSize;
+						float d = shapeDistance(point, transform.position, collider.size, collider.form, transform.rotaVec);
+						for (const auto& extra : extraColliders) {
+							d = std::min(d, shapeDistance(point, transform.position + rotate(extra.relativePos, transform.rotaVec), extra.size, extra.form, transform.rotaVec * extra.relativeRota));
+						}
+						const size_t index = size_t(y) * dimX + x;
+						if (d < distances[index]) {
+							distances[index] = d;
+							nearest[index] = ent;
+						}
+					}
+				}
+			}
+		}
+	);
+}
+
+StaticSDF::Sample StaticSDF::sample(Vec2 pos) const
+{
+	const Vec2 cell = (pos - origin) * (1.0f / cellSize);
+	const float cellX = std::floor(cell.x);
+	const float cellY = std::floor(cell.y);
+	const int32_t x = int32_t(cellX);
+	const int32_t y = int32_t(cellY);
+	if (x < 0 || y < 0 || x + 1 >= dimX || y + 1 >= dimY) {
+		return Sample{ band, Vec2{ 0, 0 }, INVALID_ENTITY_HANDLE_INDEX };
+	}
+
+	const float fx = cell.x - cellX;
+	const float fy = cell.y - cellY;
+	const float d00 = distance(x, y);
+	const float d10 = distance(x + 1, y);
+	const float d01 = distance(x, y + 1);
+	const float d11 = distance(x + 1, y + 1);
+
+	Sample result;
+	result.distance = (d00 * (1.0f - fx) + d10 * fx) * (1.0f - fy) + (d01 * (1.0f - fx) + d11 * fx) * fy;
+
+	// derivative of the bilinear interpolation:
+	const Vec2 gradient{
+		(d10 - d00) * (1.0f - fy) + (d11 - d01) * fy,
+		(d01 - d00) * (1.0f - fx) + (d11 - d10) * fx
+	};
+	const float gradientLength = length(gradient);
+	result.gradient = gradientLength > 0.0f ? gradient * (1.0f / gradientLength) : Vec2{ 0, 1 };
+
+	// the shape nearest to the corner with the smallest distance:
+	const float cornerDistances[4]{ d00, d10, d01, d11 };
+	const size_t cornerIndices[4]{
+		size_t(y) * dimX + x,		size_t(y) * dimX + x + 1,
+		size_t(y + 1) * dimX + x,	size_t(y + 1) * dimX + x + 1
+	};
+	const size_t closest = size_t(std::min_element(cornerDistances, cornerDistances + 4) - cornerDistances);
+	result.nearest = nearest[cornerIndices[closest]];
+	return result;
+}
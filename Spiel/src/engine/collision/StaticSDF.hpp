@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "CollisionUniform.hpp"
+#include "collision_detection.hpp"
+
+/**
+ * Signed distance field of the static colliders, sampled on a uniform grid.
+ * Every sample stores the distance to the nearest static shape, negative inside of a shape, and the entity of that shape.
+ * Distances are only exact within the band around the shapes, samples further away store the band width.
+ * A circle is tested against all statics with one bilinear lookup at its center.
+ * Statics hidden from the static category are left out, like in the static broadphase.
+ */
+class StaticSDF {
+public:
+	static constexpr float DEFAULT_CELL_SIZE{ 0.1f };
+	static constexpr float DEFAULT_BAND{ 1.0f };
+	static constexpr size_t MAX_SAMPLES{ 1 << 22 };
+	static constexpr size_t MIN_ROWS_PER_CHUNK{ 16 };
+
+	struct Sample {
+		float distance;
+		Vec2 gradient;					// direction of increasing distance, normalized, points away from the nearest shape
+		EntityHandleIndex nearest;		// INVALID_ENTITY_HANDLE_INDEX outside of the band
+	};
+
+	/**
+	 * \param cellSize distance of neighbouring samples, it is raised for big worlds so that no more than MAX_SAMPLES samples are used.
+	 * \param band distance around the shapes in which the field is exact.
+	 */
+	StaticSDF(float cellSize = DEFAULT_CELL_SIZE, float band = DEFAULT_BAND);
+
+	/**
+	 * samples the field of the given static colliders again, the samples are computed in parallel.
+	 *
+	 * \param aabbs aabb sizes, indexed by entity.
+	 */
+	void bake(CollisionSECM world, const std::vector<EntityHandleIndex>& statics, const std::vector<Vec2>& aabbs);
+
+	/**
+	 * \return bilinear interpolated distance and gradient at the position. Positions outside of the field are at band distance.
+	 */
+	Sample sample(Vec2 pos) const;
+
+	/**
+	 * \return true if a circle of the given radius is fully tested by sampling its center.
+	 */
+	bool coversRadius(float radius) const { return radius <= band - 2.0f * cellSize; }
+
+	/**
+	 * \return group mask bits of any baked static, colliders ignoring one of these bits can not use the field.
+	 */
+	CollisionMask getGroupMaskUnion() const { return groupMaskUnion; }
+
+	float getCellSize() const { return cellSize; }
+	float getBand() const { return band; }
+	size_t getSampleCount() const { return distances.size(); }
+	size_t getBakeCount() const { return bakeCount; }
+private:
+	float distance(int32_t x, int32_t y) const
+	{
+		if (x < 0 || y < 0 || x >= dimX || y >= dimY) return band;
+		return distances[size_t(y) * dimX + x];
+	}
+
+	const float baseCellSize;
+	float cellSize;
+	float band;
+	Vec2 origin{ 0, 0 };
+	int32_t dimX{ 0 };
+	int32_t dimY{ 0 };
+	CollisionMask groupMaskUnion{ 0 };
+	size_t bakeCount{ 0 };
+	std::vector<float> distances;				// row major
+	std::vector<EntityHandleIndex> nearest;		// row major
+};
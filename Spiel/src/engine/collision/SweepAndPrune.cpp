@@ -0,0 +1,206 @@
+#include "SweepAndPrune.hpp"
+
+SweepAndPrune::SweepAndPrune(CollisionSECM world) :
+	world{ world }
+{ }
+
+void SweepAndPrune::addEntities(const std::vector<EntityHandleIndex>& entities, uint8_t colliderTag, uint8_t querriedTags, bool detectable)
+{
+	for (const auto ent : entities) {
+		const Collider& collider = world.getComp<Collider>(ent);
+
+		uint8_t querried = querriedTags;
+		for (uint8_t tag = Collider::DYNAMIC; tag <= Collider::SENSOR; tag <<= 1) {
+			if (collider.isIgnoring(tag)) {
+				querried &= ~tag;
+			}
+		}
+		const uint8_t tag = detectable && !collider.isIgnoredBy(colliderTag) ? colliderTag : 0;
+		if (tag == 0 && querried == 0) continue;	// can neither find nor be found
+
+		if (entityStates.size() <= ent) {
+			entityStates.resize(ent + 1);
+		}
+		EntityState& state = entityStates[ent];
+		state.lastAdded = updateCount;
+		state.tag = tag;
+		state.querriedTags = querried;
+		if (!state.member) {
+			state.member = true;
+			proxies.push_back(Proxy{ 0.0f, 0.0f, 0.0f, 0.0f, ent, tag, querried });
+			newProxies += 1;
+		}
+	}
+}
+
+void SweepAndPrune::update(const std::vector<Vec2>& aabbs)
+{
+	// remove the proxies of entities that were not added, the compaction keeps the sort order:
+	proxies.erase(
+		std::remove_if(proxies.begin(), proxies.end(),
+			[&](const Proxy& proxy) {
+				EntityState& state = entityStates[proxy.entity];
+				if (state.lastAdded != updateCount) {
+					state.member = false;
+					return true;
+				}
+				return false;
+			}
+		),
+		proxies.end()
+	);
+
+	// refresh the bounds and gather the position variance per axis:
+	struct AxisStats {
+		Vec2 sum{ 0, 0 };
+		Vec2 sumSquared{ 0, 0 };
+		Vec2 maxExtent{ 0, 0 };
+	};
+	const size_t chunks = JobSystem::chunkCount(proxies.size(), MIN_PROXIES_PER_CHUNK);
+	std::vector<AxisStats> chunkStats(chunks);
+	JobSystem::parallelForChunks(proxies.size(), chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			AxisStats stats;
+			for (size_t i = begin; i < end; ++i) {
+				Proxy& proxy = proxies[i];
+				const EntityState& state = entityStates[proxy.entity];
+				const Vec2 pos = world.getComp<Transform>(proxy.entity).position;
+				const Vec2 lower = pos - aabbs[proxy.entity] * 0.5f;
+				const Vec2 upper = pos + aabbs[proxy.entity] * 0.5f;
+				proxy.min = lower[axis];
+				proxy.max = upper[axis];
+				proxy.otherMin = lower[1 - axis];
+				proxy.otherMax = upper[1 - axis];
+				proxy.tag = state.tag;
+				proxy.querriedTags = state.querriedTags;
+
+				stats.sum += pos;
+				stats.sumSquared += Vec2{ pos.x * pos.x, pos.y * pos.y };
+				stats.maxExtent = max(stats.maxExtent, aabbs[proxy.entity]);
+			}
+			chunkStats[chunk] = stats;
+		}
+	);
+	AxisStats stats;
+	for (const auto& s : chunkStats) {
+		stats.sum += s.sum;
+		stats.sumSquared += s.sumSquared;
+		stats.maxExtent = max(stats.maxExtent, s.maxExtent);
+	}
+
+	bool fullSort = newProxies > MAX_INSERTION_SORT_NEW_PROXIES;
+	if (!proxies.empty()) {
+		const float n = float(proxies.size());
+		const Vec2 mean = stats.sum / n;
+		const float varianceX = stats.sumSquared.x / n - mean.x * mean.x;
+		const float varianceY = stats.sumSquared.y / n - mean.y * mean.y;
+		const int newAxis =
+			varianceY > varianceX * AXIS_SWITCH_RATIO ? 1 :
+			varianceX > varianceY * AXIS_SWITCH_RATIO ? 0 :
+			axis;
+		if (newAxis != axis) {
+			// the order along the old axis is no help for the new one:
+			for (auto& proxy : proxies) {
+				std::swap(proxy.min, proxy.otherMin);
+				std::swap(proxy.max, proxy.otherMax);
+			}
+			axis = newAxis;
+			fullSort = true;
+		}
+	}
+	maxExtent = stats.maxExtent[axis];
+
+	if (fullSort) {
+		std::sort(proxies.begin(), proxies.end(),
+			[](const Proxy& a, const Proxy& b) {
+				return a.min < b.min || (a.min == b.min && a.entity < b.entity);
+			}
+		);
+		lastSortSwapCount = proxies.size();
+	}
+	else {
+		insertionSort();
+	}
+
+	newProxies = 0;
+	updateCount += 1;
+}
+
+void SweepAndPrune::insertionSort()
+{
+	size_t swaps{ 0 };
+	for (size_t i = 1; i < proxies.size(); ++i) {
+		const Proxy proxy = proxies[i];
+		size_t j = i;
+		while (j > 0 && proxies[j - 1].min > proxy.min) {
+			proxies[j] = proxies[j - 1];
+			--j;
+		}
+		proxies[j] = proxy;
+		swaps += i - j;
+	}
+	lastSortSwapCount = swaps;
+}
+
+void SweepAndPrune::findPairs(std::vector<EntityPair>& pairs)
+{
+	pairs.clear();
+
+	const size_t chunks = JobSystem::chunkCount(proxies.size(), MIN_PROXIES_PER_CHUNK);
+	if (chunkPairs.size() < chunks) {
+		chunkPairs.resize(chunks);
+	}
+	JobSystem::parallelForChunks(proxies.size(), chunks,
+		[&](size_t chunk, size_t begin, size_t end, uint32_t threadId) {
+			auto& out = chunkPairs[chunk];
+			out.clear();
+			for (size_t i = begin; i < end; ++i) {
+				const Proxy& a = proxies[i];
+				// all proxies starting before a ends overlap with a on the sweep axis:
+				for (size_t j = i + 1; j < proxies.size() && proxies[j].min <= a.max; ++j) {
+					const Proxy& b = proxies[j];
+					if (overlapsOtherAxis(a, b) && isInterested(a, b)) {
+						out.push_back(a.entity < b.entity ? EntityPair{ a.entity, b.entity } : EntityPair{ b.entity, a.entity });
+					}
+				}
+			}
+		}
+	);
+
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		pairs.insert(pairs.end(), chunkPairs[chunk].begin(), chunkPairs[chunk].end());
+	}
+}
+
+void SweepAndPrune::querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, uint8_t colliderTags) const
+{
+	const Vec2 lower = qryPos - qrySize * 0.5f;
+	const Vec2 upper = qryPos + qrySize * 0.5f;
+
+	// no proxy starting before lower - maxExtent can reach into the querry:
+	auto iter = std::lower_bound(proxies.begin(), proxies.end(), lower[axis] - maxExtent,
+		[](const Proxy& proxy, float value) { return proxy.min < value; });
+	for (; iter != proxies.end() && iter->min <= upper[axis]; ++iter) {
+		if (iter->max >= lower[axis] &&
+			iter->otherMin <= upper[1 - axis] &&
+			iter->otherMax >= lower[1 - axis] &&
+			(iter->tag & colliderTags)) {
+			rVec.push_back(iter->entity);
+		}
+	}
+}
+
+void SweepAndPrune::querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const
+{
+	for (const auto& proxy : proxies) {
+		Vec2 lower, upper;
+		lower[axis] = proxy.min;
+		upper[axis] = proxy.max;
+		lower[1 - axis] = proxy.otherMin;
+		upper[1 - axis] = proxy.otherMax;
+		const Vec2 pos = (lower + upper) * 0.5f;
+		const Vec2 size = upper - lower;
+		draw.push_back(makeSprite(0, pos, 0.1f, size, Vec4(0, 0, 0, 1), Form::Rectangle, RotaVec2(0)));
+		draw.push_back(makeSprite(0, pos, 0.11f, size - Vec2(0.02f, 0.02f), color, Form::Rectangle, RotaVec2(0)));
+	}
+}
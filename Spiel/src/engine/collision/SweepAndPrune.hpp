@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "CollisionUniform.hpp"
+#include "Broadphase.hpp"
+
+/**
+ * Sort and sweep broadphase over the colliders of all categories.
+ * The aabbs are kept sorted by their lower bound along the axis in which the collider positions vary most.
+ * As colliders move little from frame to frame, the order of the last frame is nearly sorted
+ * and an insertion sort restores it in close to linear time.
+ * Instead of answering querries per entity, the sweep reports every overlapping pair once.
+ */
+class SweepAndPrune {
+public:
+	static constexpr size_t MIN_PROXIES_PER_CHUNK{ 256 };
+	static constexpr float AXIS_SWITCH_RATIO{ 1.5f };	// the other axis must vary this much more, so the axis does not flip every frame
+	static constexpr size_t MAX_INSERTION_SORT_NEW_PROXIES{ 64 };	// more new proxies than this are sorted in with a full sort
+
+	SweepAndPrune(CollisionSECM world);
+
+	/**
+	 * adds the entities of one collider category to the next update. Must be called every frame for every category before update.
+	 *
+	 * \param colliderTag category of the entities.
+	 * \param querriedTags categories the entities collide with.
+	 * \param detectable false, if the entities can not be found by others, they still find the categories in querriedTags.
+	 */
+	void addEntities(const std::vector<EntityHandleIndex>& entities, uint8_t colliderTag, uint8_t querriedTags, bool detectable);
+
+	/**
+	 * removes the entities that were not added since the last update, refreshes the bounds and restores the sort order.
+	 *
+	 * \param aabbs aabb sizes, indexed by entity.
+	 */
+	void update(const std::vector<Vec2>& aabbs);
+
+	/**
+	 * sweeps over the sorted aabbs.
+	 * A pair is reported, if the aabbs overlap and at least one of them querries the category of the other.
+	 * The order of the pairs is deterministic.
+	 *
+	 * \param pairs is cleared and filled with the overlapping pairs.
+	 */
+	void findPairs(std::vector<EntityPair>& pairs);
+
+	/**
+	 * appends every entity of the given categories whose aabb overlaps with the given box to rVec.
+	 * Can be called from multiple threads at the same time.
+	 */
+	void querry(FrameVector<EntityHandleIndex>& rVec, const Vec2 qryPos, const Vec2 qrySize, uint8_t colliderTags) const;
+
+	void querryDebugAll(std::vector<Sprite>& draw, const Vec4 color) const;
+
+	size_t size() const { return proxies.size(); }
+	/**
+	 * \return 0 if the aabbs are sorted along the x axis, 1 for the y axis.
+	 */
+	int getAxis() const { return axis; }
+	/**
+	 * \return count of swaps the insertion sort needed in the last update. Low values mean good temporal coherence.
+	 */
+	size_t getLastSortSwapCount() const { return lastSortSwapCount; }
+private:
+	struct Proxy {
+		float min;			// bounds on the sweep axis
+		float max;
+		float otherMin;		// bounds on the other axis
+		float otherMax;
+		EntityHandleIndex entity;
+		uint8_t tag;		// category, 0 if the entity can not be found
+		uint8_t querriedTags;
+	};
+	struct EntityState {
+		uint32_t lastAdded{ 0 };
+		uint8_t tag{ 0 };
+		uint8_t querriedTags{ 0 };
+		bool member{ false };
+	};
+
+	static bool overlapsOtherAxis(const Proxy& a, const Proxy& b)
+	{
+		return a.otherMin <= b.otherMax && b.otherMin <= a.otherMax;
+	}
+	static bool isInterested(const Proxy& a, const Proxy& b)
+	{
+		return (a.querriedTags & b.tag) | (b.querriedTags & a.tag);
+	}
+	void insertionSort();
+
+	CollisionSECM world;
+
+	int axis{ 0 };
+	uint32_t updateCount{ 1 };
+	size_t newProxies{ 0 };
+	size_t lastSortSwapCount{ 0 };
+	float maxExtent{ 0.0f };	// biggest aabb extent along the sweep axis
+	std::vector<Proxy> proxies;	// sorted by min
+	std::vector<EntityState> entityStates;	// indexed by entity
+	std::vector<std::vector<EntityPair>> chunkPairs;
+};
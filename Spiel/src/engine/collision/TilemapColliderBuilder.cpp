@@ -0,0 +1,102 @@
+#include "TilemapColliderBuilder.hpp"
+
+#include <algorithm>
+
+TilemapColliderBuilder::TilemapColliderBuilder(uint32_t width, uint32_t height) :
+	width{ width },
+	height{ height },
+	solid(size_t(width) * height, 0),
+	cellRect(size_t(width) * height, NO_RECT)
+{ }
+
+void TilemapColliderBuilder::setSolid(uint32_t x, uint32_t y, bool solid)
+{
+	this->solid[index(x, y)] = uint8_t(solid);
+}
+
+void TilemapColliderBuilder::build()
+{
+	rects.clear();
+	freeRects.clear();
+	std::fill(cellRect.begin(), cellRect.end(), NO_RECT);
+	if (width > 0 && height > 0) {
+		merge(0, 0, width - 1, height - 1, nullptr);
+	}
+}
+
+TilemapColliderBuilder::Patch TilemapColliderBuilder::setTile(uint32_t x, uint32_t y, bool solid)
+{
+	Patch patch;
+	if (isSolid(x, y) == solid) return patch;
+	this->solid[index(x, y)] = uint8_t(solid);
+
+	// the rectangles of the tile and its neighbours are merged again, so a new solid tile can join them:
+	uint32_t minX = x, minY = y, maxX = x, maxY = y;
+	auto removeAt = [&](uint32_t cx, uint32_t cy) {
+		const uint32_t id = cellRect[index(cx, cy)];
+		if (id == NO_RECT) return;
+		const Rect rect = rects[id];
+		minX = std::min(minX, rect.x);
+		minY = std::min(minY, rect.y);
+		maxX = std::max(maxX, rect.x + rect.width - 1);
+		maxY = std::max(maxY, rect.y + rect.height - 1);
+		removeRect(id);
+		patch.removed.push_back(id);
+	};
+	removeAt(x, y);
+	if (x > 0) removeAt(x - 1, y);
+	if (x + 1 < width) removeAt(x + 1, y);
+	if (y > 0) removeAt(x, y - 1);
+	if (y + 1 < height) removeAt(x, y + 1);
+
+	merge(minX, minY, maxX, maxY, &patch.added);
+	return patch;
+}
+
+void TilemapColliderBuilder::merge(uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, std::vector<uint32_t>* added)
+{
+	for (uint32_t y = minY; y <= maxY; ++y) {
+		for (uint32_t x = minX; x <= maxX; ++x) {
+			if (!isFree(x, y)) continue;
+
+			uint32_t rectWidth = 1;
+			while (x + rectWidth < width && isFree(x + rectWidth, y)) {
+				rectWidth += 1;
+			}
+			uint32_t rectHeight = 1;
+			while (y + rectHeight < height) {
+				bool rowFree = true;
+				for (uint32_t rx = x; rx < x + rectWidth && rowFree; ++rx) {
+					rowFree = isFree(rx, y + rectHeight);
+				}
+				if (!rowFree) break;
+				rectHeight += 1;
+			}
+
+			uint32_t id;
+			if (freeRects.empty()) {
+				id = uint32_t(rects.size());
+				rects.push_back(Rect{});
+			}
+			else {
+				id = freeRects.back();
+				freeRects.pop_back();
+			}
+			rects[id] = Rect{ x, y, rectWidth, rectHeight };
+			for (uint32_t ry = y; ry < y + rectHeight; ++ry) {
+				std::fill_n(cellRect.begin() + index(x, ry), rectWidth, id);
+			}
+			if (added) added->push_back(id);
+		}
+	}
+}
+
+void TilemapColliderBuilder::removeRect(uint32_t id)
+{
+	const Rect rect = rects[id];
+	for (uint32_t ry = rect.y; ry < rect.y + rect.height; ++ry) {
+		std::fill_n(cellRect.begin() + index(rect.x, ry), rect.width, NO_RECT);
+	}
+	rects[id].width = 0;
+	freeRects.push_back(id);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <cinttypes>
+
+#include "../../engine/math/Vec2.hpp"
+
+/**
+ * Merges the solid cells of a tilemap into few axis aligned rectangles, so a map needs far less static colliders than solid cells.
+ * Every solid cell that is not part of a rectangle yet starts a new one,
+ * it is grown to the right as far as possible and then upwards as long as the whole row is solid and free (greedy meshing).
+ * The builder keeps the rectangle of every cell, so a changed tile only merges the cells of the rectangles around it again.
+ * Cell (0,0) is the bottom left cell.
+ */
+class TilemapColliderBuilder {
+public:
+	static constexpr uint32_t NO_RECT{ 0xFFFFFFFF };
+
+	/**
+	 * rectangle of cells, width 0 marks a removed rectangle whose slot is reused.
+	 */
+	struct Rect {
+		uint32_t x;
+		uint32_t y;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	/**
+	 * rectangles that have to be removed and created, after a tile changed.
+	 */
+	struct Patch {
+		std::vector<uint32_t> removed;
+		std::vector<uint32_t> added;	// may contain slots of removed rectangles
+	};
+
+	TilemapColliderBuilder(uint32_t width, uint32_t height);
+
+	/**
+	 * sets a cell without merging, used to fill the map before build.
+	 */
+	void setSolid(uint32_t x, uint32_t y, bool solid);
+
+	bool isSolid(uint32_t x, uint32_t y) const { return solid[index(x, y)] != 0; }
+
+	/**
+	 * throws away all rectangles and merges all solid cells.
+	 */
+	void build();
+
+	/**
+	 * changes a tile of a built map. The rectangles of the tile and its four neighbours are removed and their cells are merged again.
+	 *
+	 * \return the removed and the new rectangles.
+	 */
+	Patch setTile(uint32_t x, uint32_t y, bool solid);
+
+	/**
+	 * \return rectangle slots, indexed by rectangle id.
+	 */
+	const std::vector<Rect>& getRects() const { return rects; }
+
+	/**
+	 * \return id of the rectangle containing the cell, NO_RECT for empty cells.
+	 */
+	uint32_t rectOf(uint32_t x, uint32_t y) const { return cellRect[index(x, y)]; }
+
+	/**
+	 * \return count of rectangles that are not removed.
+	 */
+	size_t rectCount() const { return rects.size() - freeRects.size(); }
+
+	/**
+	 * \param origin world position of the center of cell (0,0).
+	 * \return world position of the center of the rectangle.
+	 */
+	static Vec2 rectCenter(const Rect& rect, Vec2 origin, float cellSize)
+	{
+		return origin + Vec2{ (float(rect.width) - 1.0f) * 0.5f + float(rect.x), (float(rect.height) - 1.0f) * 0.5f + float(rect.y) } * cellSize;
+	}
+
+	/**
+	 * \param tileSize size of the collider of one tile, it can be bigger than the cell size to let neighbouring tiles overlap.
+	 * \return size of a collider covering the tiles of the rectangle.
+	 */
+	static Vec2 rectSize(const Rect& rect, float cellSize, Vec2 tileSize)
+	{
+		return Vec2{ float(rect.width - 1), float(rect.height - 1) } * cellSize + tileSize;
+	}
+
+	uint32_t getWidth() const { return width; }
+	uint32_t getHeight() const { return height; }
+private:
+	size_t index(uint32_t x, uint32_t y) const { return size_t(y) * width + x; }
+	bool isFree(uint32_t x, uint32_t y) const { return solid[index(x, y)] && cellRect[index(x, y)] == NO_RECT; }
+
+	/**
+	 * merges the free solid cells in the given cell range into new rectangles.
+	 * Rectangles can grow out of the range, into free solid cells.
+	 */
+	void merge(uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, std::vector<uint32_t>* added);
+	void removeRect(uint32_t id);
+
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> solid;
+	std::vector<uint32_t> cellRect;
+	std::vector<Rect> rects;
+	std::vector<uint32_t> freeRects;
+};
@@ -86,6 +86,8 @@ CollisionTestResult rectangleRectangleCollisionCheck2(CollidableAdapter const& c
 				result.collisionCount = 2;
 				result.collisionPos = result1.pos1;
 				result.collisionPos2 = result1.pos2;
+				result.feature = makeBoxContactFeature(false, result1.referenceFace, result1.incidentCorner, false);
+				result.feature2 = makeBoxContactFeature(false, result1.referenceFace, result1.incidentCorner, true);
 
 			}
 			else {
@@ -96,6 +98,8 @@ CollisionTestResult rectangleRectangleCollisionCheck2(CollidableAdapter const& c
 				result.collisionCount = 2;
 				result.collisionPos = result2.pos2;
 				result.collisionPos2 = result2.pos1;
+				result.feature = makeBoxContactFeature(true, result2.referenceFace, result2.incidentCorner, true);
+				result.feature2 = makeBoxContactFeature(true, result2.referenceFace, result2.incidentCorner, false);
 			}
 		}
 	}
@@ -191,6 +195,8 @@ SATTestResult partialSATTest(CollidableAdapter const& coll, CollidableAdapter co
 				}
 				testResult.cornerPosOfMinClippingDist = cornersOther[index];
 				testResult.collisionNormalOfMinClippingDist = factor * relativePlaneColl;
+				testResult.referenceFace = uint32_t(i) * 2 + (factor < 0.0f ? 1 : 0);
+				testResult.incidentCorner = uint32_t(index);
 				// vectors that point from collisionpoint up to the corners connected to the collision point:
 				Vec2 dToLeft  = cornersOther[fastMod(index - 1)] - cornersOther[index];
 				Vec2 dToRight = cornersOther[fastMod(index + 1)] - cornersOther[index];
@@ -266,6 +272,75 @@ CollisionTestResult collisionTest(CollidableAdapter const& coll, CollidableAdapt
 	}
 }
 
+bool isPointInShape(CollidableAdapter const& shape, Vec2 point)
+{
+	if (shape.form == Form::Circle) {
+		const Vec2 d = point - shape.position;
+		return dot(d, d) <= shape.size.x * shape.size.x * 0.25f;
+	}
+	else {
+		const Vec2 local = rotateInverse(point - shape.position, shape.rotationVec);
+		return std::abs(local.x) <= shape.size.x * 0.5f && std::abs(local.y) <= shape.size.y * 0.5f;
+	}
+}
+
+std::optional<RayIntersection> intersectRayShape(CollidableAdapter const& shape, Vec2 origin, Vec2 delta, float maxFraction)
+{
+	const Vec2 reverseDir = dot(delta, delta) > 0.0f ? -normalize(delta) : Vec2{ 1, 0 };
+	if (shape.form == Form::Circle) {
+		// solve |origin + delta * t - center| = radius for the smaller t:
+		const Vec2 f = origin - shape.position;
+		const float radius = shape.size.x * 0.5f;
+		const float a = dot(delta, delta);
+		const float b = dot(f, delta);
+		const float c = dot(f, f) - radius * radius;
+		if (c <= 0.0f) {
+			return RayIntersection{ 0.0f, reverseDir };
+		}
+		const float discriminant = b * b - a * c;
+		if (a == 0.0f || discriminant < 0.0f) {
+			return {};
+		}
+		const float t = (-b - std::sqrt(discriminant)) / a;
+		if (t < 0.0f || t > maxFraction) {
+			return {};
+		}
+		return RayIntersection{ t, normalize(f + delta * t) };
+	}
+	else {
+		// slab test in the space of the rectangle:
+		const Vec2 localOrigin = rotateInverse(origin - shape.position, shape.rotationVec);
+		const Vec2 localDelta = rotateInverse(delta, shape.rotationVec);
+		const Vec2 half = shape.size * 0.5f;
+		float tMin = 0.0f;
+		float tMax = maxFraction;
+		Vec2 localNormal{ 0, 0 };
+		for (int axis = 0; axis < 2; ++axis) {
+			const float o = axis == 0 ? localOrigin.x : localOrigin.y;
+			const float d = axis == 0 ? localDelta.x : localDelta.y;
+			const float h = axis == 0 ? half.x : half.y;
+			if (d == 0.0f) {
+				if (o < -h || o > h) return {};
+				continue;
+			}
+			float tNear = (-h - o) / d;
+			float tFar = (h - o) / d;
+			const float side = d > 0.0f ? -1.0f : 1.0f;
+			if (tNear > tFar) std::swap(tNear, tFar);
+			if (tNear > tMin) {
+				tMin = tNear;
+				localNormal = axis == 0 ? Vec2{ side, 0 } : Vec2{ 0, side };
+			}
+			tMax = std::min(tMax, tFar);
+			if (tMin > tMax) return {};
+		}
+		if (localNormal == Vec2{ 0, 0 }) {	// the origin is inside
+			return RayIntersection{ 0.0f, reverseDir };
+		}
+		return RayIntersection{ tMin, rotate(localNormal, shape.rotationVec) };
+	}
+}
+
 CollisionTestResult collisionTestCachedAABB(CollidableAdapter const& coll_, CollidableAdapter const& other_) 
 {
 	if (coll_.form == Form::Circle) {
@@ -7,15 +7,40 @@
 #include "../../engine/math/Vec2.hpp"
 #include "../../engine/entity/EntityTypes.hpp"
 #include "../../engine/rendering/Sprite.hpp"
+#include "../../engine/allocator/ArenaAllocatorPerThread.hpp"
 #include "CollisionUniform.hpp"
 
+/**
+ * identifies the features of two shapes that produce a contact point, so the point can be matched across frames.
+ * A box contact is a corner or edge of the incident box, clipped against a face of the reference box.
+ * bit 0: set if the reference face belongs to the other shape,
+ * bit 1-2: reference face, bit 3-4: incident corner, bit 5: set if the point lies on the edge to the next corner instead of the previous one,
+ * bit 8 and above: index of the shape pair for compound colliders.
+ * Circles have no reference face and use 0.
+ */
+using ContactFeatureId = uint32_t;
+
+inline ContactFeatureId makeBoxContactFeature(bool referenceIsOther, uint32_t referenceFace, uint32_t incidentCorner, bool nextEdge)
+{
+	return uint32_t(referenceIsOther) | (referenceFace << 1) | (incidentCorner << 3) | (uint32_t(nextEdge) << 5);
+}
+
+/**
+ * \return the same feature, seen from the other shape.
+ */
+inline ContactFeatureId mirrorContactFeature(ContactFeatureId feature)
+{
+	return feature ^ 1;
+}
+
 struct CollPoint {
-	CollPoint(Vec2 p, Vec2 n, float c)
-		:pos{ p }, norm{ n }, clip{ c }
+	CollPoint(Vec2 p, Vec2 n, float c, ContactFeatureId f = 0)
+		:pos{ p }, norm{ n }, clip{ c }, feature{ f }
 	{}
 	Vec2 pos;
 	Vec2 norm;
 	float clip;
+	ContactFeatureId feature;
 };
 
 struct CollidableAdapter {
@@ -48,6 +73,8 @@ struct CollisionTestResult {
 	Vec2 collisionPos2;
 	float clippingDist;
 	int collisionCount;
+	ContactFeatureId feature{ 0 };
+	ContactFeatureId feature2{ 0 };
 
 	CollisionTestResult() 
 		: collisionPos{ 0, 0 }, collisionCount{ 0 }, clippingDist{ 0.0f }, collisionNormal{ 1,0 } 
@@ -61,9 +88,11 @@ struct CollisionInfo {
 	Vec2 position[2];
 	int collisionPointNum;
 	float clippingDist;
+	ContactFeatureId feature[2];
 
-	CollisionInfo(EntityHandleIndex idA, EntityHandleIndex idB, float clippingDist, Vec2 collisionNormal, Vec2 collisionNormal2, Vec2 collisionPos, Vec2 collisionPos2, int collCount)
-		: indexA{ idA }, indexB{ idB }, clippingDist{ clippingDist }, normal{ collisionNormal, collisionNormal2 }, position{ collisionPos, collisionPos2 }, collisionPointNum{ collCount }
+	CollisionInfo() = default;
+	CollisionInfo(EntityHandleIndex idA, EntityHandleIndex idB, float clippingDist, Vec2 collisionNormal, Vec2 collisionNormal2, Vec2 collisionPos, Vec2 collisionPos2, int collCount, ContactFeatureId feature1 = 0, ContactFeatureId feature2 = 0)
+		: indexA{ idA }, indexB{ idB }, clippingDist{ clippingDist }, normal{ collisionNormal, collisionNormal2 }, position{ collisionPos, collisionPos2 }, collisionPointNum{ collCount }, feature{ feature1, feature2 }
 	{}
 };
 
@@ -107,17 +136,37 @@ struct SATTestResult {
 	Vec2 pos1;
 	Vec2 pos2;
 	Vec2 collisionNormalOfMinClippingDist{ 1,0 };
+	uint32_t referenceFace{ 0 };	// face of coll: 0 = -x, 1 = +x, 2 = -y, 3 = +y
+	uint32_t incidentCorner{ 0 };	// corner of other, pos1 lies on the edge to the previous corner, pos2 on the edge to the next one
 };
 
 SATTestResult partialSATTest(CollidableAdapter const& coll, CollidableAdapter const& other);
 
-CollisionTestResult circleCircleCollisionCheck(CollidableAdapter const& coll, CollidableAdapter const& other, bool bothSolid);
+CollisionTestResult circleCircleCollisionCheck(CollidableAdapter const& coll, CollidableAdapter const& other);
 
 CollisionTestResult rectangleRectangleCollisionCheck2(CollidableAdapter const& coll, CollidableAdapter const& other);
 
 CollisionTestResult rectangleRectangleCollisionCheck3(CollidableAdapter const& coll, CollidableAdapter const& other);
 
-CollisionTestResult checkCircleRectangleCollision(CollidableAdapter const& circle, CollidableAdapter const& rect, bool bothSolid, bool isCirclePrimary);
+/**
+ * \param isCirclePrimary true if the result is seen from the circle, false if it is seen from the rectangle.
+ */
+CollisionTestResult checkCircleRectangleCollision(CollidableAdapter const& circle, CollidableAdapter const& rect, bool isCirclePrimary);
+
+/**
+ * \return size of the aabb around the collider and all of its extra colliders, centered on the entity position.
+ */
+inline Vec2 colliderAABB(const Transform& base, const Collider& collider)
+{
+	Vec2 aabb = collider.form == Form::Circle ? collider.size : aabbBounds(collider.size, base.rotaVec);
+	for (auto& c : collider.extraColliders()) {
+		Vec2 extra = c.form == Form::Circle ? c.size : aabbBounds(c.size, base.rotaVec * c.relativeRota);
+		Vec2 offset = rotate(c.relativePos, base.rotaVec);
+		extra += abs(offset) * 2;
+		aabb = max(aabb, extra);
+	}
+	return aabb;
+}
 
 inline bool isOverlappingAABB(Vec2 const a_pos, Vec2 const a_AABB, Vec2 const b_pos, Vec2 const b_AABB) 
 {
@@ -130,114 +179,178 @@ CollisionTestResult collisionTest(CollidableAdapter const& coll_, CollidableAdap
 
 CollisionTestResult collisionTest(CollidableAdapter const& coll_, CollidableAdapter const& other_);
 
+struct RayIntersection {
+	float fraction;		// 0 at the origin, 1 at the end of the ray
+	Vec2 normal;		// surface normal at the intersection
+};
 
-inline void generateCollisionInfos2(
-	CollisionSECM manager,
-	std::vector<CollisionInfo>& collisionInfos,
-	std::vector<Vec2> const& aabbCache,
-	const std::vector<EntityHandleIndex>& nearCollidablesBuffer,
+/**
+ * \return true if the point is inside of the shape or on its border.
+ */
+bool isPointInShape(CollidableAdapter const& shape, Vec2 point);
+
+/**
+ * intersects the segment from origin to origin + delta with the border of the shape.
+ * A segment that starts inside of the shape intersects at fraction 0 with a normal against delta.
+ * 
+ * \param maxFraction intersections behind this fraction are ignored.
+ * \return first intersection along the segment, if there is one.
+ */
+std::optional<RayIntersection> intersectRayShape(CollidableAdapter const& shape, Vec2 origin, Vec2 delta, float maxFraction = 1.0f);
+
+
+/**
+ * runs the narrowphase for one pair of colliders.
+ * 
+ * \param collisionVertices buffer for the contact points of compound colliders.
+ * \return collision of me with other, seen from me, if they collide.
+ */
+inline std::optional<CollisionInfo> generateCollisionInfo(
 	const EntityHandleIndex me,
 	const Transform& baseColl,
 	const Collider& colliderColl,
-	const Vec2 aabbMe,
-	std::vector<CollPoint>& collisionVertices)
+	const EntityHandleIndex otherEnt,
+	const Transform& baseOther,
+	const Collider& colliderOther,
+	FrameVector<CollPoint>& collisionVertices)
 {
 	const CollidableAdapter collAdapter = CollidableAdapter(
 		baseColl.position,
 		colliderColl.size,
 		colliderColl.form,
 		baseColl.rotaVec);
+	if (!colliderColl.hasExtraColliders() & !colliderOther.hasExtraColliders()) {
+		CollidableAdapter otherAdapter(
+			baseOther.position,
+			colliderOther.size,
+			colliderOther.form,
+			baseOther.rotaVec);
+
+		const auto newTestResult = collisionTest(collAdapter, otherAdapter);
+		if (newTestResult.collisionCount > 0) {
+			return CollisionInfo(me, otherEnt, newTestResult.clippingDist, newTestResult.collisionNormal, newTestResult.collisionNormal, newTestResult.collisionPos, newTestResult.collisionPos2, newTestResult.collisionCount, newTestResult.feature, newTestResult.feature2);
+		}
+	}
+	else {
+		collisionVertices.clear();
+
+		CollidableAdapter otherAdapter(baseOther.position, colliderOther.size, colliderOther.form, baseOther.rotaVec);
+		// the features of the shapes are tagged with the index of the tested shape pair:
+		uint32_t shapePair = 0;
+		auto testForCollision = [&](CollidableAdapter collAdapter, CollidableAdapter otherAdapter) {
+			const auto newTestResult = collisionTest(collAdapter, otherAdapter);
+			if (newTestResult.collisionCount >= 1)
+				collisionVertices.push_back({ newTestResult.collisionPos, newTestResult.collisionNormal, newTestResult.clippingDist, newTestResult.feature | (shapePair << 8) });
+			if (newTestResult.collisionCount == 2)
+				collisionVertices.push_back({ newTestResult.collisionPos2, newTestResult.collisionNormal, newTestResult.clippingDist, newTestResult.feature2 | (shapePair << 8) });
+			shapePair += 1;
+		};
+		testForCollision(collAdapter, otherAdapter);
+		for (auto& oc : colliderOther.extraColliders()) {
+			CollidableAdapter otherAdapter(baseOther.position + rotate(oc.relativePos, baseOther.rotaVec), oc.size, oc.form, baseOther.rotaVec * oc.relativeRota);
+			testForCollision(collAdapter, otherAdapter);
+		}
+		for (auto& cc : colliderColl.extraColliders()) {
+			const CollidableAdapter collAdapter = CollidableAdapter(baseColl.position + rotate(cc.relativePos, baseColl.rotaVec), cc.size, cc.form, baseColl.rotaVec * cc.relativeRota);
+			testForCollision(collAdapter, otherAdapter);
+			for (auto& oc : colliderOther.extraColliders()) {
+				CollidableAdapter otherAdapter(baseOther.position + rotate(oc.relativePos, baseOther.rotaVec), oc.size, oc.form, baseOther.rotaVec * oc.relativeRota);
+				testForCollision(collAdapter, otherAdapter);
+			}
+		}
+		if (collisionVertices.size() > 1) {
+			Vec2 minV{ FLT_MIN, FLT_MIN };
+			Vec2 maxV{ FLT_MAX, FLT_MAX };
+			for (const auto& v : collisionVertices) {
+				minV = min(v.pos, minV);
+				maxV = max(v.pos, maxV);
+			}
+			Vec2 midPoint = minV + maxV * 0.5f;
+			int vertex1 = 0;
+			float mostMiddleDistance = distance(collisionVertices[0].pos, midPoint);
+			for (int i = 1; i < collisionVertices.size(); i++) {
+				float newMiddleDistance = distance(collisionVertices[i].pos, midPoint);
+				if (newMiddleDistance > mostMiddleDistance) {
+					vertex1 = i;
+					mostMiddleDistance = newMiddleDistance;
+				}
+			}
+
+			int vertex2 = vertex1;
+			float distVertex = 0.0f;
+			for (int i = 0; i < collisionVertices.size(); i++) {
+				float newDist = distance(collisionVertices[i].pos, collisionVertices[vertex1].pos);
+				if (newDist > distVertex) {
+					vertex2 = i;
+					distVertex = newDist;
+				}
+			}
+
+			// point one is allways on the left side, point two is allways on the right
+			Vec2 centerTangent = rotate<90>(normalize(baseOther.position - baseColl.position));	// dot < 0 = left side dot > 0 = right side
+			Vec2 relPosV1 = collisionVertices[vertex1].pos - baseColl.position;
+			Vec2 relPosV2 = collisionVertices[vertex2].pos - baseColl.position;
+			// when vertex1 is more right than vertex2 we swap them
+			if (dot(relPosV1, centerTangent) > dot(relPosV2, centerTangent)) {
+				std::swap(vertex1, vertex2);
+			}
+
+			float clip = (collisionVertices[vertex1].clip + collisionVertices[vertex2].clip) * 0.5f;
+			return CollisionInfo(me, otherEnt, clip, collisionVertices[vertex1].norm, collisionVertices[vertex2].norm, collisionVertices[vertex1].pos, collisionVertices[vertex2].pos, 2, collisionVertices[vertex1].feature, collisionVertices[vertex2].feature);
+		}
+		else if (collisionVertices.size() == 1) {
+			return CollisionInfo(me, otherEnt, collisionVertices[0].clip, collisionVertices[0].norm, collisionVertices[0].norm, collisionVertices[0].pos, collisionVertices[0].pos, 1, collisionVertices[0].feature, collisionVertices[0].feature);
+		}
+	}
+	return {};
+}
+
+/**
+ * \return the collision info seen from the other entity.
+ * The normals point in the opposite direction and, as the left and right side swap, the two contact points swap.
+ */
+inline CollisionInfo mirrorCollisionInfo(CollisionInfo const& info)
+{
+	const ContactFeatureId feature0 = mirrorContactFeature(info.feature[0]);
+	const ContactFeatureId feature1 = mirrorContactFeature(info.feature[1]);
+	if (info.collisionPointNum > 1) {
+		return CollisionInfo(info.indexB, info.indexA, info.clippingDist, -info.normal[1], -info.normal[0], info.position[1], info.position[0], info.collisionPointNum, feature1, feature0);
+	}
+	else {
+		return CollisionInfo(info.indexB, info.indexA, info.clippingDist, -info.normal[0], -info.normal[1], info.position[0], info.position[1], info.collisionPointNum, feature0, feature1);
+	}
+}
+
+/**
+ * \return count of near entities that were rejected, because colliderColl ignores their collision group.
+ */
+inline size_t generateCollisionInfos2(
+	CollisionSECM manager,
+	std::vector<CollisionInfo>& collisionInfos,
+	std::vector<Vec2> const& aabbCache,
+	const FrameVector<EntityHandleIndex>& nearCollidablesBuffer,
+	const EntityHandleIndex me,
+	const Transform& baseColl,
+	const Collider& colliderColl,
+	const Vec2 aabbMe,
+	FrameVector<CollPoint>& collisionVertices)
+{
+	size_t rejectedByGroup{ 0 };
 	for (const auto otherEnt : nearCollidablesBuffer) {
 		if (me != otherEnt) { //do not check against self
 			const auto& baseOther = manager.getComp<Transform>(otherEnt);
 			const auto& colliderOther = manager.getComp<Collider>(otherEnt);
-			if (!(
-				colliderColl.ignoreGroupMask
-				& colliderOther.groupMask)
-				) {
+			if (colliderColl.ignoreGroupMask & colliderOther.groupMask) {
+				rejectedByGroup += 1;
+			}
+			else {
 				if (isOverlappingAABB(baseColl.position, aabbMe, baseOther.position, aabbCache.at(otherEnt))) {
-					if (colliderColl.extraColliders.empty() & colliderOther.extraColliders.empty()) {
-						CollidableAdapter otherAdapter(
-							baseOther.position,
-							colliderOther.size,
-							colliderOther.form,
-							baseOther.rotaVec);
-
-						const auto newTestResult = collisionTest(collAdapter, otherAdapter);
-						if (newTestResult.collisionCount > 0) {
-							collisionInfos.push_back(CollisionInfo(me, otherEnt, newTestResult.clippingDist, newTestResult.collisionNormal, newTestResult.collisionNormal, newTestResult.collisionPos, newTestResult.collisionPos2, newTestResult.collisionCount));
-						}
-					}
-					else {
-						collisionVertices.clear();
-
-						CollidableAdapter otherAdapter(baseOther.position, colliderOther.size, colliderOther.form, baseOther.rotaVec);
-						auto testForCollision = [&](CollidableAdapter collAdapter, CollidableAdapter otherAdapter) {
-							const auto newTestResult = collisionTest(collAdapter, otherAdapter);
-							if (newTestResult.collisionCount >= 1)
-								collisionVertices.push_back({ newTestResult.collisionPos, newTestResult.collisionNormal, newTestResult.clippingDist });
-							if (newTestResult.collisionCount == 2)
-								collisionVertices.push_back({ newTestResult.collisionPos2, newTestResult.collisionNormal, newTestResult.clippingDist });
-						};
-						testForCollision(collAdapter, otherAdapter);
-						for (auto& oc : colliderOther.extraColliders) {
-							CollidableAdapter otherAdapter(baseOther.position + rotate(oc.relativePos, baseOther.rotaVec), oc.size, oc.form, baseOther.rotaVec * oc.relativeRota);
-							testForCollision(collAdapter, otherAdapter);
-						}
-						for (auto& cc : colliderColl.extraColliders) {
-							const CollidableAdapter collAdapter = CollidableAdapter(baseColl.position + rotate(cc.relativePos, baseColl.rotaVec), cc.size, cc.form, baseColl.rotaVec * cc.relativeRota);
-							testForCollision(collAdapter, otherAdapter);
-							for (auto& oc : colliderOther.extraColliders) {
-								CollidableAdapter otherAdapter(baseOther.position + rotate(oc.relativePos, baseOther.rotaVec), oc.size, oc.form, baseOther.rotaVec * oc.relativeRota);
-								testForCollision(collAdapter, otherAdapter);
-							}
-						}
-						if (collisionVertices.size() > 1) {
-							Vec2 minV{ FLT_MIN, FLT_MIN };
-							Vec2 maxV{ FLT_MAX, FLT_MAX };
-							for (const auto& v : collisionVertices) {
-								minV = min(v.pos, minV);
-								maxV = max(v.pos, maxV);
-							}
-							Vec2 midPoint = minV + maxV * 0.5f;
-							int vertex1 = 0;
-							float mostMiddleDistance = distance(collisionVertices[0].pos, midPoint);
-							for (int i = 1; i < collisionVertices.size(); i++) {
-								float newMiddleDistance = distance(collisionVertices[i].pos, midPoint);
-								if (newMiddleDistance > mostMiddleDistance) {
-									vertex1 = i;
-									mostMiddleDistance = newMiddleDistance;
-								}
-							}
-
-							int vertex2 = vertex1;
-							float distVertex = 0.0f;
-							for (int i = 0; i < collisionVertices.size(); i++) {
-								float newDist = distance(collisionVertices[i].pos, collisionVertices[vertex1].pos);
-								if (newDist > distVertex) {
-									vertex2 = i;
-									distVertex = newDist;
-								}
-							}
-
-							// point one is allways on the left side, point two is allways on the right
-							Vec2 centerTangent = rotate<90>(normalize(baseOther.position - baseColl.position));	// dot < 0 = left side dot > 0 = right side
-							Vec2 relPosV1 = collisionVertices[vertex1].pos - baseColl.position;
-							Vec2 relPosV2 = collisionVertices[vertex2].pos - baseColl.position;
-							// when vertex1 is more right than vertex2 we swap them
-							if (dot(relPosV1, centerTangent) > dot(relPosV2, centerTangent)) {
-								std::swap(vertex1, vertex2);
-							}
-
-							float clip = (collisionVertices[vertex1].clip + collisionVertices[vertex2].clip) * 0.5f;
-							collisionInfos.push_back(CollisionInfo(me, otherEnt, clip, collisionVertices[vertex1].norm, collisionVertices[vertex2].norm, collisionVertices[vertex1].pos, collisionVertices[vertex2].pos, 2));
-						}
-						else if (collisionVertices.size() == 1) {
-							collisionInfos.push_back(CollisionInfo(me, otherEnt, collisionVertices[0].clip, collisionVertices[0].norm, collisionVertices[0].norm, collisionVertices[0].pos, collisionVertices[0].pos, 1));
-						}
+					if (auto info = generateCollisionInfo(me, baseColl, colliderColl, otherEnt, baseOther, colliderOther, collisionVertices)) {
+						collisionInfos.push_back(*info);
 					}
 				}
 			}
 		}
 	}
+	return rejectedByGroup;
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "EntityTypes.hpp"
+
+enum class ComponentEvent : uint8_t {
+	Insert,
+	Remove
+};
+
+struct ComponentEventRecord {
+	EntityHandleIndex entity;
+	ComponentEvent event;
+};
+
+/**
+ * Buffer of (entity, event) pairs, filled by a component storage in batched mode.
+ * A queue is owned by its consumer and attached to exactly one storage.
+ * The consumer drains it once per frame, at a point where the storage is not modified.
+ * As the buffer keeps its capacity, steady state batching does not allocate.
+ */
+class ComponentEventQueue {
+public:
+	void push(EntityHandleIndex entity, ComponentEvent event)
+	{
+		events.push_back(ComponentEventRecord{ entity, event });
+	}
+
+	/**
+	 * calls the given function for every queued event in order of occurrence and clears the queue.
+	 *
+	 * \param function callable with signature void(EntityHandleIndex, ComponentEvent).
+	 */
+	template<typename F>
+	void drain(F&& function)
+	{
+		for (ComponentEventRecord const& record : events) {
+			function(record.entity, record.event);
+		}
+		events.clear();
+	}
+	void clear() { events.clear(); }
+	bool empty() const { return events.empty(); }
+	size_t size() const { return events.size(); }
+	auto begin() const { return events.begin(); }
+	auto end() const { return events.end(); }
+private:
+	std::vector<ComponentEventRecord> events;
+};
+
+template<typename CompType>
+using ComponentCallback = void(*)(EntityHandleIndex, CompType&);
+
+/**
+ * List of typed observers of one component storage event.
+ * Observers are free functions or member functions bound to an instance.
+ * Functions known at compile time are called through a thunk generated per function, so there is no type erasure besides one function pointer.
+ */
+template<typename CompType>
+class ComponentObserverList {
+	struct Observer;
+	using Thunk = void(*)(Observer const&, EntityHandleIndex, CompType&);
+	struct Observer {
+		void* instance{ nullptr };
+		ComponentCallback<CompType> function{ nullptr };
+		Thunk thunk{ nullptr };
+
+		bool operator==(Observer const& rhs) const
+		{
+			return instance == rhs.instance && function == rhs.function && thunk == rhs.thunk;
+		}
+	};
+public:
+	/**
+	 * registers a free function, given at runtime.
+	 */
+	void add(ComponentCallback<CompType> function)
+	{
+		observers.push_back(Observer{ nullptr, function, &callRuntimeFunction });
+	}
+	/**
+	 * registers a free function, given at compile time.
+	 */
+	template<auto Function>
+	void add()
+	{
+		observers.push_back(Observer{ nullptr, nullptr, &callFunction<Function> });
+	}
+	/**
+	 * registers a member function of T, called on the given instance.
+	 * The instance must outlive the registration.
+	 */
+	template<auto Method, typename T>
+	void add(T* instance)
+	{
+		observers.push_back(Observer{ static_cast<void*>(instance), nullptr, &callMethod<Method, T> });
+	}
+
+	void remove(ComponentCallback<CompType> function)
+	{
+		erase(Observer{ nullptr, function, &callRuntimeFunction });
+	}
+	template<auto Function>
+	void remove()
+	{
+		erase(Observer{ nullptr, nullptr, &callFunction<Function> });
+	}
+	template<auto Method, typename T>
+	void remove(T* instance)
+	{
+		erase(Observer{ static_cast<void*>(instance), nullptr, &callMethod<Method, T> });
+	}
+	void clear() { observers.clear(); }
+	bool empty() const { return observers.empty(); }
+
+	void notify(EntityHandleIndex entity, CompType& comp) const
+	{
+		for (Observer const& observer : observers) {
+			observer.thunk(observer, entity, comp);
+		}
+	}
+private:
+	void erase(Observer const& observer)
+	{
+		observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+	}
+
+	static void callRuntimeFunction(Observer const& observer, EntityHandleIndex entity, CompType& comp)
+	{
+		observer.function(entity, comp);
+	}
+	template<auto Function>
+	static void callFunction(Observer const&, EntityHandleIndex entity, CompType& comp)
+	{
+		Function(entity, comp);
+	}
+	template<auto Method, typename T>
+	static void callMethod(Observer const& observer, EntityHandleIndex entity, CompType& comp)
+	{
+		(static_cast<T*>(observer.instance)->*Method)(entity, comp);
+	}
+
+	std::vector<Observer> observers;
+};
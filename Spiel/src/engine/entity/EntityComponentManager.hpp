@@ -1,6 +1,10 @@
 #pragma once
 
+#include <span>
+
 #include "EntityComponentManagerView.hpp"
+#include "../JobSystem.hpp"
+#include "../util/utils.hpp"
 
 template<class ... TComponentStorage>
 class EntityComponentManager : public EntityManager {
@@ -12,35 +16,52 @@ public:
 	 * 
 	 * \param callback function that is called directly after a component was added to an entity.
 	 */
-	template<typename CompType> void setOnAddCallback(ComponentCallback<CompType> callback)
+	template<typename CompType> void addOnAddCallback(ComponentCallback<CompType> callback)
 	{
-		storage<CompType>().setCallbackOnInsert(callback);
+		storage<CompType>().insertObservers().add(callback);
 	}
 
 	/**
 	 * adds a callback specific to this ECM, that is called directly before a component is removed from an entity.
 	 * 
+	 * When destroyed entities are deregistered in update(), the callback may be called from a worker thread.
+	 * 
 	 * \param callback function that is called directly before a component is removed from an entity.
 	 */
-	template<typename CompType> void setOnRemCallback(ComponentCallback<CompType> callback)
+	template<typename CompType> void addOnRemCallback(ComponentCallback<CompType> callback)
 	{
-		storage<CompType>().setCallbackOnRemove(callback);
+		storage<CompType>().removeObservers().add(callback);
 	}
 
 	/**
 	 * removes onAddCallback for component, for this ECM.
 	 */
-	template<typename CompType> void removeOnAddCallback()
+	template<typename CompType> void removeOnAddCallback(ComponentCallback<CompType> callback)
 	{
-		storage<CompType>().removeCallBackOnInsert();
+		storage<CompType>().insertObservers().remove(callback);
 	}
 
 	/**
-	 * removes onAddCallback for component, for this ECM.
+	 * removes onRemCallback for component, for this ECM.
+	 */
+	template<typename CompType> void removeOnRemCallback(ComponentCallback<CompType> callback)
+	{
+		storage<CompType>().removeObservers().remove(callback);
+	}
+
+	/**
+	 * attaches a queue that collects every add and remove of the component type, to be processed in one batch.
+	 * 
+	 * \param queue owned by the caller, must be detached before it is destroyed.
 	 */
-	template<typename CompType> void removeCallBackOnRemove()
+	template<typename CompType> void attachEventQueue(ComponentEventQueue& queue)
 	{
-		storage<CompType>().setCallbackOnRemove();
+		storage<CompType>().attachEventQueue(&queue);
+	}
+
+	template<typename CompType> void detachEventQueue(ComponentEventQueue& queue)
+	{
+		storage<CompType>().detachEventQueue(&queue);
 	}
 
 	template<typename CompType>		CompType& getComp(EntityHandleIndex index)
@@ -120,14 +141,44 @@ public:
 		return true;
 	}
 
-	template<typename CompType>		CompType&	addComp(EntityHandleIndex index, CompType data = CompType())
+	/**
+	 * constructs the component in place from the given arguments.
+	 */
+	template<typename CompType, typename... Args>	CompType& emplaceComp(EntityHandleIndex index, Args&&... args)
 	{
-		storage<CompType>().insert(index, data);
-		return storage<CompType>().get(index);
+		return storage<CompType>().emplace(index, std::forward<Args>(args)...);
 	}
-	template<typename CompType>		CompType&	addComp(EntityHandle entity, CompType data = CompType())
+	template<typename CompType, typename... Args>	CompType& emplaceComp(EntityHandle entity, Args&&... args)
 	{
-		return addComp<CompType>(entity.index, data);
+		return emplaceComp<CompType>(entity.index, std::forward<Args>(args)...);
+	}
+
+	template<typename CompType>		CompType& addComp(EntityHandleIndex index)
+	{
+		return emplaceComp<CompType>(index);
+	}
+	template<typename CompType>		CompType& addComp(EntityHandle entity)
+	{
+		return emplaceComp<CompType>(entity.index);
+	}
+	template<typename CompType>		CompType& addComp(EntityHandleIndex index, CompType const& data)
+	{
+		return emplaceComp<CompType>(index, data);
+	}
+	template<typename CompType>		CompType& addComp(EntityHandle entity, CompType const& data)
+	{
+		return emplaceComp<CompType>(entity.index, data);
+	}
+	// the constraint makes sure that this overload only takes rvalues, as CompType&& is a forwarding reference when deduced
+	template<typename CompType> requires (!std::is_lvalue_reference_v<CompType>)
+	CompType& addComp(EntityHandleIndex index, CompType&& data)
+	{
+		return emplaceComp<CompType>(index, std::move(data));
+	}
+	template<typename CompType> requires (!std::is_lvalue_reference_v<CompType>)
+	CompType& addComp(EntityHandle entity, CompType&& data)
+	{
+		return emplaceComp<CompType>(entity.index, std::move(data));
 	}
 
 	template<typename CompType>		void remComp(EntityHandleIndex index)
@@ -148,7 +199,13 @@ public:
 		[[nodiscard]]
 		bool has() { return manager.hasComps<CompTypes...>(entity); }
 		template<typename CompType>
-		CompType& add(CompType comp = CompType()) { return manager.addComp<CompType>(entity, comp); }
+		CompType& add() { return manager.addComp<CompType>(entity); }
+		template<typename CompType>
+		CompType& add(CompType const& comp) { return manager.addComp<CompType>(entity, comp); }
+		template<typename CompType> requires (!std::is_lvalue_reference_v<CompType>)
+		CompType& add(CompType&& comp) { return manager.addComp<CompType>(entity, std::move(comp)); }
+		template<typename CompType, typename... Args>
+		CompType& emplace(Args&&... args) { return manager.emplaceComp<CompType>(entity, std::forward<Args>(args)...); }
 		template<typename CompType>
 		[[nodiscard]]
 		CompType& get() { return manager.getComp<CompType>(entity); }
@@ -200,18 +257,43 @@ public:
 
 protected:
 
+	/**
+	 * removes the components of all destroyed entities.
+	 * Every storage removes its components in one sorted batch.
+	 * For big destroy queues, the storages are processed in parallel, one job per storage.
+	 * Component observers may therefore be called from worker threads here.
+	 */
 	void deregisterDestroyedEntities()
 	{
-		util::tuple_for_each(componentStorageTuple,
-			[&](auto& componentStorage) {
-				for (EntityHandleIndex entity : destroyQueue) {
-					if (componentStorage.contains(entity)) {
-						componentStorage.remove(entity);
+		if (destroyQueue.empty()) return;
+
+		sortedDestroyQueue.assign(destroyQueue.begin(), destroyQueue.end());
+		std::sort(sortedDestroyQueue.begin(), sortedDestroyQueue.end());
+		const std::span<const EntityHandleIndex> entities{ sortedDestroyQueue };
+
+		if (entities.size() < PARALLEL_DEREGISTRATION_MIN_ENTITIES) {
+			util::tuple_for_each(componentStorageTuple,
+				[&](auto& componentStorage) {
+					componentStorage.removeBatch(entities);
+				}
+			);
+		}
+		else {
+			std::vector<LambdaJob> jobs;
+			util::tuple_for_each(componentStorageTuple,
+				[&](auto& componentStorage) {
+					if (componentStorage.size() > 0) {
+						jobs.push_back(LambdaJob([&componentStorage, entities](uint32_t threadId) {
+							componentStorage.removeBatch(entities);
+						}));
 					}
 				}
-			}
-		);
+			);
+			JobSystem::wait(JobSystem::submitVec(std::move(jobs)));
+		}
 	}
 
+	static constexpr size_t PARALLEL_DEREGISTRATION_MIN_ENTITIES{ 64 };
+	std::vector<EntityHandleIndex> sortedDestroyQueue;
 	CompStoreTupleType componentStorageTuple;
 };
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <tuple>
 #include <functional>
 #include <array>
+#include <type_traits>
 
 #include "EntityComponentStorage.hpp"
 #include "EntityManager.hpp"
@@ -156,6 +157,14 @@ public:
 	{
 		return getComp<CompType>(entity.index);
 	}
+	template<typename CompType>		const CompType& getComp(EntityHandleIndex index) const
+	{
+		return storage<CompType>().get(index);
+	}
+	template<typename CompType>		const CompType& getComp(EntityHandle entity) const
+	{
+		return getComp<CompType>(entity.index);
+	}
 
 	template<typename CompType>		CompType* getIf(EntityHandleIndex index)
 	{
@@ -188,6 +197,14 @@ public:
 	{
 		return hasComp<CompType>(entity.index);
 	}
+	template<typename CompType>		bool hasComp(EntityHandleIndex index) const
+	{
+		return storage<CompType>().contains(index);
+	}
+	template<typename CompType>		bool hasComp(EntityHandle entity) const
+	{
+		return hasComp<CompType>(entity.index);
+	}
 	
 	template<> bool hasComp<void>(EntityHandle entity)
 	{
@@ -202,6 +219,14 @@ public:
 	{
 		return hasComps<CompTypes...>(entity.index);
 	}
+	template<typename... CompTypes> bool hasComps(EntityHandleIndex index) const
+	{
+		return (hasComp<CompTypes>(index) && ...);
+	}
+	template<typename... CompTypes> bool hasComps(EntityHandle entity) const
+	{
+		return hasComps<CompTypes...>(entity.index);
+	}
 
 	template<typename CompType>		bool hasntComp(EntityHandleIndex index)
 	{
@@ -226,14 +251,44 @@ public:
 		return hasntComps<CompTypes...>(entity.index);
 	}
 
-	template<typename CompType>		CompType& addComp(EntityHandleIndex index, CompType data = CompType())
+	/**
+	 * constructs the component in place from the given arguments.
+	 */
+	template<typename CompType, typename... Args>	CompType& emplaceComp(EntityHandleIndex index, Args&&... args)
 	{
-		storage<CompType>().insert(index, data);
-		return storage<CompType>().get(index);
+		return storage<CompType>().emplace(index, std::forward<Args>(args)...);
 	}
-	template<typename CompType>		CompType& addComp(EntityHandle entity, CompType data = CompType())
+	template<typename CompType, typename... Args>	CompType& emplaceComp(EntityHandle entity, Args&&... args)
 	{
-		return addComp<CompType>(entity.index, data);
+		return emplaceComp<CompType>(entity.index, std::forward<Args>(args)...);
+	}
+
+	template<typename CompType>		CompType& addComp(EntityHandleIndex index)
+	{
+		return emplaceComp<CompType>(index);
+	}
+	template<typename CompType>		CompType& addComp(EntityHandle entity)
+	{
+		return emplaceComp<CompType>(entity.index);
+	}
+	template<typename CompType>		CompType& addComp(EntityHandleIndex index, CompType const& data)
+	{
+		return emplaceComp<CompType>(index, data);
+	}
+	template<typename CompType>		CompType& addComp(EntityHandle entity, CompType const& data)
+	{
+		return emplaceComp<CompType>(entity.index, data);
+	}
+	// the constraint makes sure that this overload only takes rvalues, as CompType&& is a forwarding reference when deduced
+	template<typename CompType> requires (!std::is_lvalue_reference_v<CompType>)
+	CompType& addComp(EntityHandleIndex index, CompType&& data)
+	{
+		return emplaceComp<CompType>(index, std::move(data));
+	}
+	template<typename CompType> requires (!std::is_lvalue_reference_v<CompType>)
+	CompType& addComp(EntityHandle entity, CompType&& data)
+	{
+		return emplaceComp<CompType>(entity.index, std::move(data));
 	}
 
 	template<typename CompType>		void remComp(EntityHandleIndex index)
@@ -245,6 +300,15 @@ public:
 		remComp<CompType>(entity.index);
 	}
 
+	template<typename CompType>		void attachEventQueue(ComponentEventQueue& queue)
+	{
+		storage<CompType>().attachEventQueue(&queue);
+	}
+	template<typename CompType>		void detachEventQueue(ComponentEventQueue& queue)
+	{
+		storage<CompType>().detachEventQueue(&queue);
+	}
+
 	template<typename FirstComp, typename ... RestComps>
 	[[nodiscard]]
 	auto entityView()
@@ -265,6 +329,11 @@ public:
 	{
 		return *std::get<findIndexInTuple<0, CompType, std::tuple<CompStoreType...>>()>(compStorePtrTuple);
 	}
+	template<typename CompType>
+	constexpr const auto& storage() const
+	{
+		return *std::get<findIndexInTuple<0, CompType, std::tuple<CompStoreType...>>()>(compStorePtrTuple);
+	}
 private:
 
 	bool isIndexValid(EntityHandleIndex index) const
@@ -6,8 +6,12 @@
 #include <variant>
 #include <tuple>
 #include <vector>
+#include <memory>
+#include <span>
+#include <algorithm>
 
 #include "EntityTypes.hpp"
+#include "ComponentObserver.hpp"
 
 #ifdef _DEBUG
 #define DEBUG_COMPONENT_STORAGE
@@ -23,9 +27,6 @@
 #define compStoreAssert(x)
 #endif
 
-template<typename CompType>
-using ComponentCallback = std::function<void(EntityHandleIndex, CompType&)>;
-
 /**
  * This is an abstract class/ Interface for the component storage classes.
  * It defines an Interface, every comp store class must implement.
@@ -40,29 +41,65 @@ public:
 
 	// access:
 	void insert(EntityHandleIndex entity, CompType const& comp) { assertNoPolyNoBase(); }
+	void insert(EntityHandleIndex entity, CompType&& comp) { assertNoPolyNoBase(); }
+	template<typename... Args>
+	CompType& emplace(EntityHandleIndex entity, Args&&... args) { assertNoPolyNoBase(); }
 	void remove(EntityHandleIndex entity) { assertNoPolyNoBase(); }
-	void setCallbackOnInsert(ComponentCallback<CompType> callback)
+	void removeBatch(std::span<const EntityHandleIndex> sortedEntities) { assertNoPolyNoBase(); }
+	bool contains(EntityHandleIndex entity) const { assertNoPolyNoBase(); };
+	CompType& get(EntityHandleIndex entity) { assertNoPolyNoBase(); };
+	const CompType& get(EntityHandleIndex entity) const { assertNoPolyNoBase(); };
+
+	// observation:
+	/**
+	 * observers called directly after a component was inserted.
+	 */
+	ComponentObserverList<CompType>& insertObservers() { return onInsertObservers; }
+	/**
+	 * observers called directly before a component is removed.
+	 */
+	ComponentObserverList<CompType>& removeObservers() { return onRemoveObservers; }
+	/**
+	 * Batched mode: every insert and remove appends an (entity, event) pair to the attached queue.
+	 * The consumer processes the whole batch once per frame instead of reacting to every single change.
+	 * A queue may only be attached to one storage.
+	 */
+	void attachEventQueue(ComponentEventQueue* queue)
 	{
-		this->onInsertCallback = callback;
+		eventQueues.push_back(queue);
 	}
-	void setCallbackOnRemove(ComponentCallback<CompType> callback)
+	void detachEventQueue(ComponentEventQueue* queue)
 	{
-		this->onRemoveCallback = callback;
+		eventQueues.erase(std::remove(eventQueues.begin(), eventQueues.end(), queue), eventQueues.end());
 	}
-	void removeCallBackOnInsert()
+protected:
+	ComponentStorageBase() = default;
+	// observers and queues belong to the storage object, not to its content, so they are never copied:
+	ComponentStorageBase(ComponentStorageBase<CompType> const&) {}
+	ComponentStorageBase<CompType>& operator=(ComponentStorageBase<CompType> const&) { return *this; }
+
+	void notifyInsert(EntityHandleIndex entity, CompType& comp)
 	{
-		this->onInsertCallback = {};
+		onInsertObservers.notify(entity, comp);
+		for (ComponentEventQueue* queue : eventQueues) {
+			queue->push(entity, ComponentEvent::Insert);
+		}
 	}
-	void removeCallBackOnRemove()
+	void notifyRemove(EntityHandleIndex entity, CompType& comp)
 	{
-		this->onRemoveCallback = {};
+		onRemoveObservers.notify(entity, comp);
+		for (ComponentEventQueue* queue : eventQueues) {
+			queue->push(entity, ComponentEvent::Remove);
+		}
 	}
-	bool contains(EntityHandleIndex entity) const { assertNoPolyNoBase(); };
-	CompType& get(EntityHandleIndex entity) { assertNoPolyNoBase(); };
-	const CompType& get(EntityHandleIndex entity) const { assertNoPolyNoBase(); };
-protected:
-	ComponentCallback<CompType> onInsertCallback;
-	ComponentCallback<CompType> onRemoveCallback;
+	bool isObserved() const
+	{
+		return !onInsertObservers.empty() || !onRemoveObservers.empty() || !eventQueues.empty();
+	}
+
+	ComponentObserverList<CompType> onInsertObservers;
+	ComponentObserverList<CompType> onRemoveObservers;
+	std::vector<ComponentEventQueue*> eventQueues;
 private:
 	/**
 	 * This Function asserts that:
@@ -88,14 +125,15 @@ class ComponentStorageDirectIndexing : public ComponentStorageBase<CompType> {
 public:
 	~ComponentStorageDirectIndexing()
 	{
-		onRemoveCallbackOnEverything();
+		notifyRemoveOnEverything();
 	}
 
 	ComponentStorageDirectIndexing<CompType>& operator=(ComponentStorageDirectIndexing<CompType> const& rhs)
 	{
-		onRemoveCallbackOnEverything();
+		notifyRemoveOnEverything();
 		this->storage = rhs.storage;
 		this->containsVec = rhs.containsVec;
+		notifyInsertOnEverything();
 		return *this;
 	}
 
@@ -113,35 +151,55 @@ public:
 
 	// access:
 	void insert(EntityHandleIndex entity, CompType const& comp)
+	{
+		emplace(entity, comp);
+	}
+	void insert(EntityHandleIndex entity, CompType&& comp)
+	{
+		emplace(entity, std::move(comp));
+	}
+	template<typename... Args>
+	CompType& emplace(EntityHandleIndex entity, Args&&... args)
 	{
 		compStoreAssert(!contains(entity));
 		if (entity >= containsVec.size()) containsVec.resize(entity + 1, false);
 		containsVec[entity] = true;
-		if (entity < storage.size()) {
-			storage[entity] = comp;
-		}
-		else if (entity == storage.size()) {
-			storage.push_back(comp);
+		if (entity == storage.size()) {
+			storage.emplace_back(std::forward<Args>(args)...);
 		}
-		else if (entity > storage.size()) {
-			storage.resize(entity + 1, CompType());
-			storage[entity] = comp;
+		else {
+			if (entity > storage.size()) {
+				storage.resize(entity + 1);
+			}
+			std::destroy_at(&storage[entity]);
+			std::construct_at(&storage[entity], std::forward<Args>(args)...);
 		}
 
-		if (this->onInsertCallback) {
-			this->onInsertCallback(entity, storage[entity]);
-		}
+		this->notifyInsert(entity, storage[entity]);
+		return storage[entity];
 	}
 	void remove(EntityHandleIndex entity)
 	{
 		compStoreAssert(contains(entity)); 
 		
-		if (this->onRemoveCallback) {
-			this->onRemoveCallback(entity, get(entity));
-		}
+		this->notifyRemove(entity, get(entity));
 
 		containsVec[entity] = false;
 	}
+	/**
+	 * removes the components of all given entities that own one.
+	 * 
+	 * \param sortedEntities in ascending order, may contain entities without this component.
+	 */
+	void removeBatch(std::span<const EntityHandleIndex> sortedEntities)
+	{
+		for (EntityHandleIndex entity : sortedEntities) {
+			if (entity < containsVec.size() && containsVec[entity]) {
+				this->notifyRemove(entity, storage[entity]);
+				containsVec[entity] = false;
+			}
+		}
+	}
 	bool contains(EntityHandleIndex entity) const
 	{
 		compStoreAssert(entity < containsVec.size());
@@ -218,11 +276,19 @@ public:
 	iterator<CompType> end() { return iterator<CompType>(storage.size(), *this); }
 private:
 
-	void onRemoveCallbackOnEverything()
+	void notifyRemoveOnEverything()
+	{
+		if (this->isObserved()) {
+			for (auto iter = begin(); iter != end(); ++iter) {
+				this->notifyRemove(*iter, iter.data());
+			}
+		}
+	}
+	void notifyInsertOnEverything()
 	{
-		if (this->onRemoveCallback) {
+		if (this->isObserved()) {
 			for (auto iter = begin(); iter != end(); ++iter) {
-				this->onRemoveCallback(*iter, iter.data());
+				this->notifyInsert(*iter, iter.data());
 			}
 		}
 	}
@@ -244,7 +310,7 @@ public:
 	}
 	~ComponentStoragePagedIndexing()
 	{
-		onRemoveCallbackOnEverything();
+		notifyRemoveOnEverything();
 	}
 
 	// meta:
@@ -268,8 +334,9 @@ public:
 	};
 	void operator=(const ComponentStoragePagedIndexing<CompType>& rhs)
 	{
-		onRemoveCallbackOnEverything();
+		notifyRemoveOnEverything();
 		this->containsVec = rhs.containsVec;
+		this->m_size = rhs.m_size;
 
 		this->pages.resize(rhs.pages.size());
 		for (int i = 0; i < this->pages.size(); i++) {
@@ -280,10 +347,20 @@ public:
 				this->pages[i].reset();
 			}
 		}
+		notifyInsertOnEverything();
 	}
 
 	// access:
 	void insert(EntityHandleIndex entity, CompType const& comp)
+	{
+		emplace(entity, comp);
+	}
+	void insert(EntityHandleIndex entity, CompType&& comp)
+	{
+		emplace(entity, std::move(comp));
+	}
+	template<typename... Args>
+	CompType& emplace(EntityHandleIndex entity, Args&&... args)
 	{
 		compStoreAssert(!contains(entity));
 		updateMaxEntNum(entity + 1);
@@ -295,22 +372,22 @@ public:
 
 		containsVec[entity] = true;
 
-		pages[page(entity)]->data[offset(entity)] = comp;
+		// the slots of a page are always alive, so the old value is destroyed before the new one is constructed in place:
+		CompType& slot = pages[page(entity)]->data[offset(entity)];
+		std::destroy_at(&slot);
+		std::construct_at(&slot, std::forward<Args>(args)...);
 		pages[page(entity)]->usedCount += 1;
 		++m_size; 
 		
-		if (this->onInsertCallback) {
-			this->onInsertCallback(entity, pages[page(entity)]->data[offset(entity)]);
-		}
+		this->notifyInsert(entity, slot);
+		return slot;
 	}
 	void remove(EntityHandleIndex entity)
 	{
 		compStoreAssert(contains(entity));
 		containsVec[entity] = false; 
 		
-		if (this->onRemoveCallback) {
-			this->onRemoveCallback(entity, get(entity));
-		}
+		this->notifyRemove(entity, get(entity));
 
 		pages[page(entity)]->usedCount -= 1;
 		if constexpr (DELETE_EMPTY_PAGES) {
@@ -320,6 +397,36 @@ public:
 		}
 		--m_size;
 	}
+	/**
+	 * removes the components of all given entities that own one.
+	 * As the entities are sorted, the bookkeeping for each page is done once.
+	 * 
+	 * \param sortedEntities in ascending order, may contain entities without this component.
+	 */
+	void removeBatch(std::span<const EntityHandleIndex> sortedEntities)
+	{
+		auto iter = sortedEntities.begin();
+		while (iter != sortedEntities.end() && *iter < containsVec.size()) {
+			const int curPage = page(*iter);
+			size_t removedInPage{ 0 };
+			for (; iter != sortedEntities.end() && *iter < containsVec.size() && page(*iter) == curPage; ++iter) {
+				if (containsVec[*iter]) {
+					containsVec[*iter] = false;
+					this->notifyRemove(*iter, pages[curPage]->data[offset(*iter)]);
+					++removedInPage;
+				}
+			}
+			if (removedInPage > 0) {
+				pages[curPage]->usedCount -= removedInPage;
+				if constexpr (DELETE_EMPTY_PAGES) {
+					if (pages[curPage]->usedCount == 0) {
+						pages[curPage].reset();
+					}
+				}
+				m_size -= removedInPage;
+			}
+		}
+	}
 	bool contains(EntityHandleIndex entity) const
 	{
 		return entity < containsVec.size() && containsVec[entity];
@@ -433,11 +540,19 @@ public:
 		std::array<CompType, PAGE_SIZE> data;
 	};
 
-	void onRemoveCallbackOnEverything()
+	void notifyRemoveOnEverything()
+	{
+		if (this->isObserved()) {
+			for (auto iter = begin(); iter != end(); ++iter) {
+				this->notifyRemove(*iter, iter.data());
+			}
+		}
+	}
+	void notifyInsertOnEverything()
 	{
-		if (this->onRemoveCallback) {
+		if (this->isObserved()) {
 			for (auto iter = begin(); iter != end(); ++iter) {
-				this->onRemoveCallback(*iter, iter.data());
+				this->notifyInsert(*iter, iter.data());
 			}
 		}
 	}
@@ -462,7 +577,7 @@ public:
 	}
 	~ComponentStoragePagedSet()
 	{
-		onRemoveCallbackOnEverything();
+		notifyRemoveOnEverything();
 	}
 	// meta:
 	void updateMaxEntNum(EntityHandleIndex newEntNum)
@@ -487,7 +602,7 @@ public:
 	}
 	void operator=(const ComponentStoragePagedSet<CompType>& rhs)
 	{
-		onRemoveCallbackOnEverything();
+		notifyRemoveOnEverything();
 		this->denseTable = rhs.denseTable;
 		this->storage = rhs.storage;
 
@@ -500,15 +615,25 @@ public:
 				this->pages[i].reset();
 			}
 		}
+		notifyInsertOnEverything();
 	}
 
 	// access:
 	void insert(EntityHandleIndex entity, CompType const& comp)
+	{
+		emplace(entity, comp);
+	}
+	void insert(EntityHandleIndex entity, CompType&& comp)
+	{
+		emplace(entity, std::move(comp));
+	}
+	template<typename... Args>
+	CompType& emplace(EntityHandleIndex entity, Args&&... args)
 	{
 		compStoreAssert(!contains(entity));
 		updateMaxEntNum(entity + 1);
 		denseTable.push_back(entity);
-		storage.push_back(comp);
+		storage.emplace_back(std::forward<Args>(args)...);
 
 		if (!pages[page(entity)]) {
 			pages[page(entity)] = std::make_unique<Page>();
@@ -516,17 +641,14 @@ public:
 		sparseTable(entity) = (uint32_t)denseTable.size() - 1;
 		pages[page(entity)]->usedCount++; 
 		
-		if (this->onInsertCallback) {
-			this->onInsertCallback(entity, storage.back());
-		}
+		this->notifyInsert(entity, storage.back());
+		return storage.back();
 	}
 	void remove(EntityHandleIndex entity)
 	{
 		compStoreAssert(contains(entity));
 
-		if (this->onRemoveCallback) {
-			this->onRemoveCallback(entity, get(entity));
-		}
+		this->notifyRemove(entity, get(entity));
 
 		if (entity == denseTable.back()) {
 			sparseTable(entity) = 0xFFFFFFFF;
@@ -542,7 +664,7 @@ public:
 			denseTable.pop_back();
 			sparseTable(lastEnt) = slot;
 			denseTable.at(slot) = lastEnt;
-			storage.at(slot) = storage.back();
+			storage.at(slot) = std::move(storage.back());
 			storage.pop_back();
 		}
 		compStoreAssert(pages[page(entity)]->usedCount >= 0);
@@ -552,6 +674,53 @@ public:
 			}
 		}
 	}
+	/**
+	 * removes the components of all given entities that own one.
+	 * The holes are filled with the last live elements in one sweep, instead of one swap per removal.
+	 * 
+	 * \param sortedEntities in ascending order, may contain entities without this component.
+	 */
+	void removeBatch(std::span<const EntityHandleIndex> sortedEntities)
+	{
+		batchRemoveSlots.clear();
+		for (EntityHandleIndex entity : sortedEntities) {
+			if (contains(entity)) {
+				this->notifyRemove(entity, get(entity));
+				batchRemoveSlots.push_back(sparseTable(entity));
+				sparseTable(entity) = 0xFFFFFFFF;
+				pages[page(entity)]->usedCount--;
+			}
+		}
+		if (batchRemoveSlots.empty()) return;
+		std::sort(batchRemoveSlots.begin(), batchRemoveSlots.end());
+
+		uint32_t last = static_cast<uint32_t>(denseTable.size());		// end of the range that still contains elements to move into holes
+		size_t tailRemoved = batchRemoveSlots.size();					// removed slots from this index on were cut off the end
+		for (size_t i = 0; i < tailRemoved; ++i) {
+			while (tailRemoved > i && batchRemoveSlots[tailRemoved - 1] == last - 1) {
+				--tailRemoved;
+				--last;
+			}
+			if (i >= tailRemoved) break;
+			--last;
+			const uint32_t hole = batchRemoveSlots[i];
+			const EntityHandleIndex movedEnt = denseTable[last];
+			denseTable[hole] = movedEnt;
+			storage[hole] = std::move(storage[last]);
+			sparseTable(movedEnt) = hole;
+		}
+		const size_t newSize = denseTable.size() - batchRemoveSlots.size();
+		denseTable.erase(denseTable.begin() + newSize, denseTable.end());
+		storage.erase(storage.begin() + newSize, storage.end());
+
+		if constexpr (DELETE_EMPTY_PAGES) {
+			for (EntityHandleIndex entity : sortedEntities) {
+				if (page(entity) < pages.size() && pages[page(entity)] && pages[page(entity)]->usedCount == 0) {
+					pages[page(entity)].reset();
+				}
+			}
+		}
+	}
 	bool contains(EntityHandleIndex entity) const
 	{
 		return page(entity) < pages.size() && pages[page(entity)] != nullptr && sparseTable(entity) != 0xFFFFFFFF;
@@ -673,17 +842,26 @@ private:
 		return pages.csat(page(ent))->data.csat(offset(ent));
 	}
 
-	void onRemoveCallbackOnEverything()
+	void notifyRemoveOnEverything()
+	{
+		if (this->isObserved()) {
+			for (auto iter = begin(); iter != end(); ++iter) {
+				this->notifyRemove(*iter, iter.data());
+			}
+		}
+	}
+	void notifyInsertOnEverything()
 	{
-		if (this->onRemoveCallback) {
+		if (this->isObserved()) {
 			for (auto iter = begin(); iter != end(); ++iter) {
-				this->onRemoveCallback(*iter, iter.data());
+				this->notifyInsert(*iter, iter.data());
 			}
 		}
 	}
 	std::vector<std::unique_ptr<Page>> pages;
 	std::vector<EntityHandleIndex> denseTable;
 	std::vector<CompType> storage;
+	std::vector<uint32_t> batchRemoveSlots;
 };
 
 /*----------------------------------------------------------------------------------*/
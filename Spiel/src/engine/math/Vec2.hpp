@@ -251,7 +251,7 @@ public:
 		return RotaVec2(cos , -sin);
 	}
 
-	bool operator==(RotaVec2 v)
+	bool operator==(RotaVec2 v) const
 	{
 		return this->cos == v.cos && this->sin == v.sin;
 	}
@@ -39,6 +39,8 @@ void CollisionConstraintSet::insert(const EntityHandle a, const EntityHandle b,
     constraint.collisionPoints[1].normal = collinfo.normal[1];
     constraint.collisionPoints[0].position = collinfo.position[0];
     constraint.collisionPoints[1].position = collinfo.position[1];
+    constraint.collisionPoints[0].feature = collinfo.feature[0];
+    constraint.collisionPoints[1].feature = collinfo.feature[1];
     constraint.collisionPointNum = collinfo.collisionPointNum;
     constraint.clippingDist = collinfo.clippingDist;
     constraints.push_back(constraint);
@@ -32,6 +32,7 @@ struct CollisionPoint {
 	// accumulated data:
 	float accPn = 0;	// accumulated impulse to normal
 	float accPt = 0;	// accumulated impulse to tangent
+	ContactFeatureId feature = 0;	// matches the point across frames
 };
 
 struct CollisionConstraint {
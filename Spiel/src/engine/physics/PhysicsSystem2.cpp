@@ -1,10 +1,18 @@
 #include "PhysicsSystem2.hpp"
 
+#include <numeric>
+#include <bit>
+#include <atomic>
+#include <limits>
+
 void PhysicsSystem2::eraseDeadConstraints()
 {
 	uint32_t end = uint32_t(collConstraints.size());
 	for (uint32_t i = 0; i < end; i++) {
 		if (!collConstraints[i].updated) {
+			if (settings.allowSleeping) {
+				lostContacts.push_back(LostContact{ collConstraints[i].idA, collConstraints[i].idB, 0.0f });
+			}
 			collConstraints.erase(i);
 			//as the last one takes place of th erased element we have to check again against this index
 			i--;
@@ -21,11 +29,218 @@ const std::vector<Sprite>& PhysicsSystem2::getDebugSprites() const
 	return debugSprites;
 }
 
+void PhysicsSystem2::orderConstraints()
+{
+	constraintOrder.resize(collConstraints.size());
+	std::iota(constraintOrder.begin(), constraintOrder.end(), 0);
+	if (settings.deterministicOrder) {
+		std::sort(constraintOrder.begin(), constraintOrder.end(),
+			[&](uint32_t a, uint32_t b) {
+				return makeConstraintKey(collConstraints[a].idA, collConstraints[a].idB) < makeConstraintKey(collConstraints[b].idA, collConstraints[b].idB);
+			}
+		);
+	}
+}
+
+void PhysicsSystem2::colorConstraints(CollisionSECM world)
+{
+	// greedy coloring of the constraints in constraintOrder, every constraint takes the lowest color that none of its dynamic bodies uses yet.
+	// Bodies without movement are never written by the solver, so any count of constraints of a color can share them:
+	bodyColorMasks.assign(world.maxEntityIndex(), 0);
+	colorOffsets.assign(MAX_COLORS + 2, 0);
+	constraintColors.resize(collConstraints.size());
+	for (const uint32_t index : constraintOrder) {
+		const CollisionConstraint& c = collConstraints[index];
+		const bool dynamicA = world.hasComp<Movement>(c.idA);
+		const bool dynamicB = world.hasComp<Movement>(c.idB);
+		const uint32_t usedColors = (dynamicA ? bodyColorMasks[c.idA.index] : 0) | (dynamicB ? bodyColorMasks[c.idB.index] : 0);
+		const uint32_t color = uint32_t(std::countr_one(usedColors));	// MAX_COLORS if all colors are used
+		if (color < MAX_COLORS) {
+			if (dynamicA) bodyColorMasks[c.idA.index] |= 1u << color;
+			if (dynamicB) bodyColorMasks[c.idB.index] |= 1u << color;
+		}
+		constraintColors[index] = color;
+		colorOffsets[color + 1] += 1;
+	}
+	std::partial_sum(colorOffsets.begin(), colorOffsets.end(), colorOffsets.begin());
+
+	// group the constraints by color, in coloring order:
+	std::array<uint32_t, MAX_COLORS + 1> cursor;
+	std::copy(colorOffsets.begin(), colorOffsets.end() - 1, cursor.begin());
+	coloredConstraints.resize(constraintOrder.size());
+	for (const uint32_t index : constraintOrder) {
+		coloredConstraints[cursor[constraintColors[index]]++] = index;
+	}
+}
+
+template<typename F>
+void PhysicsSystem2::forEachConstraintColored(F&& function)
+{
+	// constraints of one color share no dynamic body, so they can be solved in any order and in parallel:
+	for (uint32_t color = 0; color < MAX_COLORS; ++color) {
+		const uint32_t begin = colorOffsets[color];
+		const uint32_t end = colorOffsets[color + 1];
+		if (end - begin < MIN_CONSTRAINTS_PER_BATCH * 2) {
+			for (uint32_t i = begin; i < end; ++i) {
+				function(collConstraints[coloredConstraints[i]]);
+			}
+		}
+		else {
+			JobSystem::parallelFor(end - begin, MIN_CONSTRAINTS_PER_BATCH,
+				[&](size_t batchBegin, size_t batchEnd, uint32_t threadId) {
+					for (size_t i = begin + batchBegin; i < begin + batchEnd; ++i) {
+						function(collConstraints[coloredConstraints[i]]);
+					}
+				}
+			);
+		}
+	}
+	for (uint32_t i = colorOffsets[MAX_COLORS]; i < colorOffsets[MAX_COLORS + 1]; ++i) {
+		function(collConstraints[coloredConstraints[i]]);
+	}
+}
+
+uint32_t PhysicsSystem2::findIsland(uint32_t body)
+{
+	// path halving, a failed exchange only means that an other thread shortened the path first:
+	while (true) {
+		std::atomic_ref<uint32_t> parentRef(islandParents[body]);
+		uint32_t parent = parentRef.load(std::memory_order_relaxed);
+		if (parent == body) return body;
+		const uint32_t grandParent = std::atomic_ref<uint32_t>(islandParents[parent]).load(std::memory_order_relaxed);
+		if (parent != grandParent) {
+			parentRef.compare_exchange_weak(parent, grandParent, std::memory_order_relaxed);
+		}
+		body = grandParent;
+	}
+}
+
+void PhysicsSystem2::uniteIslands(uint32_t a, uint32_t b)
+{
+	while (true) {
+		a = findIsland(a);
+		b = findIsland(b);
+		if (a == b) return;
+		if (a < b) std::swap(a, b);
+		// the higher root is linked below the lower one, this fails if an other thread linked it first:
+		uint32_t expected = a;
+		if (std::atomic_ref<uint32_t>(islandParents[a]).compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+	}
+}
+
+void PhysicsSystem2::unionIslands(CollisionSECM world)
+{
+	// parallel union-find over the dynamic bodies. Parents only ever move to lower indices, 
+	// so every island ends up with its lowest entity index as root, independent of the order of the unions.
+	// Bodies without movement are never written by the solver, they do not connect islands:
+	islandParents.resize(world.maxEntityIndex());
+	std::iota(islandParents.begin(), islandParents.end(), 0);
+	JobSystem::parallelFor(collConstraints.size(), MIN_CONSTRAINTS_PER_BATCH,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				const CollisionConstraint& c = collConstraints[i];
+				if (world.hasComp<Movement>(c.idA) && world.hasComp<Movement>(c.idB)) {
+					uniteIslands(c.idA.index, c.idB.index);
+				}
+			}
+		}
+	);
+}
+
+void PhysicsSystem2::buildIslands(CollisionSECM world)
+{
+	const uint32_t entityCount = uint32_t(world.maxEntityIndex());
+	const uint32_t count = uint32_t(collConstraints.size());
+
+	unionIslands(world);
+	constraintIslandRoots.resize(count);
+	JobSystem::parallelFor(count, MIN_CONSTRAINTS_PER_BATCH,
+		[&](size_t begin, size_t end, uint32_t threadId) {
+			for (size_t i = begin; i < end; ++i) {
+				const CollisionConstraint& c = collConstraints[i];
+				// a constraint without dynamic bodies writes no body, so it can go to any island:
+				const EntityHandleIndex body = world.hasComp<Movement>(c.idA) || !world.hasComp<Movement>(c.idB) ? c.idA.index : c.idB.index;
+				constraintIslandRoots[i] = findIsland(body);
+			}
+		}
+	);
+
+	// group the constraints by island, islands and their constraints are in the order of constraintOrder:
+	islandOfRoot.assign(entityCount, NO_ISLAND);
+	islandOffsets.assign(1, 0);
+	for (const uint32_t index : constraintOrder) {
+		uint32_t& island = islandOfRoot[constraintIslandRoots[index]];
+		if (island == NO_ISLAND) {
+			island = uint32_t(islandOffsets.size() - 1);
+			islandOffsets.push_back(0);
+		}
+		islandOffsets[island + 1] += 1;
+	}
+	std::partial_sum(islandOffsets.begin(), islandOffsets.end(), islandOffsets.begin());
+	islandCursors.assign(islandOffsets.begin(), islandOffsets.end() - 1);
+	islandConstraints.resize(count);
+	for (const uint32_t index : constraintOrder) {
+		islandConstraints[islandCursors[islandOfRoot[constraintIslandRoots[index]]]++] = index;
+	}
+
+	// large islands are split into colors, the constraints of all of them are colored together:
+	smallIslands.clear();
+	smallIslandConstraintCount = 0;
+	constraintOrder.clear();
+	for (uint32_t island = 0; island + 1 < islandOffsets.size(); ++island) {
+		const uint32_t begin = islandOffsets[island];
+		const uint32_t end = islandOffsets[island + 1];
+		if (end - begin > SPLIT_ISLAND_CONSTRAINTS) {
+			constraintOrder.insert(constraintOrder.end(), islandConstraints.begin() + begin, islandConstraints.begin() + end);
+		}
+		else {
+			smallIslands.push_back(island);
+			smallIslandConstraintCount += end - begin;
+		}
+	}
+	colorConstraints(world);
+}
+
+template<typename F>
+void PhysicsSystem2::forEachSmallIsland(F&& function)
+{
+	// islands share no dynamic body, so they can be solved in parallel:
+	auto solveIslands = [&](size_t begin, size_t end, uint32_t threadId) {
+		for (size_t i = begin; i < end; ++i) {
+			const uint32_t island = smallIslands[i];
+			function(islandOffsets[island], islandOffsets[island + 1]);
+		}
+	};
+	if (smallIslandConstraintCount < MIN_CONSTRAINTS_PER_BATCH * 2) {
+		solveIslands(0, smallIslands.size(), 0);
+	}
+	else {
+		JobSystem::parallelFor(smallIslands.size(), MIN_ISLANDS_PER_BATCH, solveIslands);
+	}
+}
+
 void PhysicsSystem2::applyImpulses(CollisionSECM world)
 {
+	if (settings.solverMode == SolverMode::Islands) {
+		// a job runs all iterations for its islands:
+		forEachSmallIsland(
+			[&](uint32_t begin, uint32_t end) {
+				for (int i = 0; i < settings.impulseResolutionIterations; ++i) {
+					for (uint32_t j = begin; j < end; ++j) {
+						applyImpulse(world, collConstraints[islandConstraints[j]]);
+					}
+				}
+			}
+		);
+	}
 	for (int i = 0; i < settings.impulseResolutionIterations; ++i) {
-		for (auto& c : collConstraints) {
-			applyImpulse(world, c);
+		if (settings.solverMode == SolverMode::Sequential) {
+			for (auto& c : collConstraints) {
+				applyImpulse(world, c);
+			}
+		}
+		else {
+			forEachConstraintColored([&](CollisionConstraint& c) { applyImpulse(world, c); });
 		}
 	}
 }
@@ -46,48 +261,95 @@ void PhysicsSystem2::drawAllCollisionConstraints()
 
 void PhysicsSystem2::updateCollisionConstraints(CollisionSECM world, CollisionSystem& collSys)
 {
-	for (auto& collisionList : collSys.collisionLists) {
-		for (CollisionInfo collinfo : collisionList) {
-			if (world.hasComp<PhysicsBody>(collinfo.indexA) && world.hasComp<PhysicsBody>(collinfo.indexB)) {
-				EntityHandle a = world.getHandle(collinfo.indexA);
-				EntityHandle b = world.getHandle(collinfo.indexB);
-				// order a and b
-				collinfo.normal[0] *= -1;			// in physics the normal goes from a to b
-				collinfo.normal[1] *= -1;			// in physics the normal goes from a to b
-				if (a.index > b.index) {
-					std::swap(a, b);
-					collinfo.normal[0] *= -1;		// in physics the normal goes from a to b
-					collinfo.normal[1] *= -1;		// in physics the normal goes from a to b
-					if (collinfo.collisionPointNum > 1) {
-						std::swap(collinfo.position[0], collinfo.position[1]);
-						std::swap(collinfo.normal[0], collinfo.normal[1]);
-					}
+	auto isSleeping = [&](EntityHandleIndex entity) {
+		return world.hasComp<Movement>(entity) && world.getComp<Movement>(entity).sleeping;
+	};
+	for (CollisionInfo collinfo : collSys.getCollisions()) {
+		if (world.hasComp<PhysicsBody>(collinfo.indexA) && world.hasComp<PhysicsBody>(collinfo.indexB)) {
+			// a contact with an awake body wakes a sleeping body, the contacts between resting bodies are kept by the sleeping islands:
+			const bool sleepingA = isSleeping(collinfo.indexA);
+			const bool sleepingB = isSleeping(collinfo.indexB);
+			if (sleepingA || sleepingB) {
+				const bool awakeA = !sleepingA && world.hasComp<Movement>(collinfo.indexA);
+				const bool awakeB = !sleepingB && world.hasComp<Movement>(collinfo.indexB);
+				if (!awakeA && !awakeB) continue;
+				if (sleepingA) wakeBody(world, collinfo.indexA);
+				if (sleepingB) wakeBody(world, collinfo.indexB);
+			}
+
+			EntityHandle a = world.getHandle(collinfo.indexA);
+			EntityHandle b = world.getHandle(collinfo.indexB);
+			// order a and b
+			collinfo.normal[0] *= -1;			// in physics the normal goes from a to b
+			collinfo.normal[1] *= -1;			// in physics the normal goes from a to b
+			if (a.index > b.index) {
+				std::swap(a, b);
+				collinfo.normal[0] *= -1;		// in physics the normal goes from a to b
+				collinfo.normal[1] *= -1;		// in physics the normal goes from a to b
+				collinfo.feature[0] = mirrorContactFeature(collinfo.feature[0]);
+				collinfo.feature[1] = mirrorContactFeature(collinfo.feature[1]);
+				if (collinfo.collisionPointNum > 1) {
+					std::swap(collinfo.position[0], collinfo.position[1]);
+					std::swap(collinfo.normal[0], collinfo.normal[1]);
+					std::swap(collinfo.feature[0], collinfo.feature[1]);
+				}
+			}
+
+			auto* optional = collConstraints.getIfContains(a, b);
+			if (optional == nullptr) {
+				collConstraints.insert(a, b, collinfo);
+			}
+			else {
+				auto& constraint = *optional;
+				if (!constraint.updated) {
+					constraint.updated = true;
+					updateCollisionPoints(constraint, collinfo);
+					constraint.clippingDist = collinfo.clippingDist;
 				}
+			}
+		}
+	}
+}
 
-				auto* optional = collConstraints.getIfContains(a, b);
-				if (optional == nullptr) {
-					collConstraints.insert(a, b, collinfo);
+void PhysicsSystem2::updateCollisionPoints(CollisionConstraint& constraint, const CollisionInfo& collinfo)
+{
+	CollisionPoint points[2];
+	for (int i = 0; i < 2; ++i) {
+		points[i].position = collinfo.position[i];
+		points[i].normal = collinfo.normal[i];
+		points[i].feature = collinfo.feature[i];
+	}
+
+	if (settings.warmStart) {
+		// every new point takes the accumulated impulses of the old point with the same features,
+		// a single point always matches a single point, as a circle contact has no features.
+		// The incident corner of a flat resting box flips between its two lower corners, that changes the features of both points without moving them,
+		// so a point without a feature match takes the impulses of the nearest old point:
+		const bool singlePoints = constraint.collisionPointNum == 1 && collinfo.collisionPointNum == 1;
+		for (int i = 0; i < collinfo.collisionPointNum; ++i) {
+			int match = -1;
+			float minDist = std::numeric_limits<float>::max();
+			for (int j = 0; j < constraint.collisionPointNum; ++j) {
+				if (singlePoints || constraint.collisionPoints[j].feature == points[i].feature) {
+					match = j;
+					break;
 				}
-				else {
-					auto& constraint = *optional;
-					if (!constraint.updated) {
-						constraint.updated = true;
-						constraint.collisionPoints[0].normal = collinfo.normal[0];
-						constraint.collisionPoints[1].normal = collinfo.normal[1];
-						if (constraint.collisionPointNum != collinfo.collisionPointNum) {
-							// reset stored impulses when contact changes dramaticly
-							constraint.collisionPoints[0] = CollisionPoint();
-							constraint.collisionPoints[1] = CollisionPoint();
-							constraint.collisionPointNum = collinfo.collisionPointNum;
-						}
-						constraint.collisionPoints[0].position = collinfo.position[0];
-						constraint.collisionPoints[1].position = collinfo.position[1];
-						constraint.clippingDist = collinfo.clippingDist;
-					}
+				const float dist = distance(constraint.collisionPoints[j].position, points[i].position);
+				if (dist < minDist) {
+					minDist = dist;
+					match = j;
 				}
 			}
+			if (match != -1) {
+				points[i].accPn = constraint.collisionPoints[match].accPn;
+				points[i].accPt = constraint.collisionPoints[match].accPt;
+			}
 		}
 	}
+
+	constraint.collisionPoints[0] = points[0];
+	constraint.collisionPoints[1] = points[1];
+	constraint.collisionPointNum = collinfo.collisionPointNum;
 }
 
 void PhysicsSystem2::clearDuplicates(CollisionSECM world, CollisionSystem& collSys)
@@ -95,129 +357,92 @@ void PhysicsSystem2::clearDuplicates(CollisionSECM world, CollisionSystem& collS
 	uniqueCollisionInfos.clear();
 	uniqueCollisionInfosSetBuffer.clear();
 
-	for (const auto& collisionList : collSys.getCollisionsLists()) {
-		for (auto const& el : collisionList) {
-			const EntityHandleIndex a = std::min(el.indexA, el.indexB);
-			const EntityHandleIndex b = std::max(el.indexA, el.indexB);
-			uint64_t key = makeConstraintKey(a, b);
-			if (!uniqueCollisionInfosSetBuffer.contains(key)) {
-				uniqueCollisionInfosSetBuffer.insert(key);
-				uniqueCollisionInfos.push_back(el);
-			}
+	for (auto const& el : collSys.getCollisions()) {
+		const EntityHandleIndex a = std::min(el.indexA, el.indexB);
+		const EntityHandleIndex b = std::max(el.indexA, el.indexB);
+		uint64_t key = makeConstraintKey(a, b);
+		if (!uniqueCollisionInfosSetBuffer.contains(key)) {
+			uniqueCollisionInfosSetBuffer.insert(key);
+			uniqueCollisionInfos.push_back(el);
 		}
 	}
 }
 
-void PhysicsSystem2::findIslands(CollisionSECM world, CollisionSystem& collSys)
+void PhysicsSystem2::prepareConstraints(CollisionSECM world, float deltaTime)
 {
-	std::vector<CollisionConstraintSet> disjointSetList;
-	CollisionConstraintSet leftOverConstraints = collConstraints; 
+	// the warm start writes the velocities of both bodies, so it is scheduled like the impulses:
+	auto prepare = [&](CollisionConstraint& c) { prepareConstraint(world, c, deltaTime); };
+	if (settings.solverMode == SolverMode::Sequential) {
+		for (auto& c : collConstraints) {
+			prepare(c);
+		}
+	}
+	else {
+		if (settings.solverMode == SolverMode::Islands) {
+			forEachSmallIsland(
+				[&](uint32_t begin, uint32_t end) {
+					for (uint32_t i = begin; i < end; ++i) {
+						prepare(collConstraints[islandConstraints[i]]);
+					}
+				}
+			);
+		}
+		forEachConstraintColored(prepare);
+	}
+}
 
-	constexpr int DISJOINT_SET_COUNT{ 5 };
+void PhysicsSystem2::prepareConstraint(CollisionSECM world, CollisionConstraint& c, float deltaTime)
+{
+	const float k_allowedPenetration = 0.01f;
+	float k_biasFactor = settings.positionCorrection ? 0.2f : 0.0f;
 
+	const EntityHandle entA = c.idA;
+	const EntityHandle entB = c.idB;
+	auto movementDummy = Movement();
+	auto& baseA = world.getComp<Transform>(entA);
+	auto& moveA = world.hasComp<Movement>(entA) ? world.getComp<Movement>(entA) : movementDummy;
+	auto& bodyA = world.getComp<PhysicsBody>(entA);
+	auto& baseB = world.getComp<Transform>(entB);
+	auto& moveB = world.hasComp<Movement>(entB) ? world.getComp<Movement>(entB) : movementDummy;
+	auto& bodyB = world.getComp<PhysicsBody>(entB);
 
-	for (int i = 0; i < DISJOINT_SET_COUNT; i++) {
-		CollisionConstraintSet disjointSet;
-		robin_hood::unordered_set<EntityHandleIndex> invalidSet;
+	c.friction = sqrt(bodyA.friction * bodyB.friction);
+	float restitution = 1.0f + std::max(bodyA.elasticity, bodyB.elasticity);
+	c.bias = -k_biasFactor * (1.0f / deltaTime) * std::min(0.0f, -c.clippingDist + k_allowedPenetration);
 
-		for (auto const& c : leftOverConstraints) {
-			const EntityHandle a = c.idA.index < c.idB.index ? c.idA : c.idB;
-			const EntityHandle b = c.idA.index < c.idB.index ? c.idB : c.idA;
+	for (int i = 0; i < c.collisionPointNum; i++) {
+		Vec2 tangent = rotate<270>(c.collisionPoints[i].normal);
+		Vec2 r1 = c.collisionPoints[i].position - baseA.position;
+		Vec2 r2 = c.collisionPoints[i].position - baseB.position;
 
-			if (!invalidSet.contains(a.index) && !invalidSet.contains(b.index)) {
-				disjointSet.insert(a, b, c);
-				leftOverConstraints.erase(a, b);
-				invalidSet.insert(a.index);
-				invalidSet.insert(b.index);
-			}
-		}
-		
-		disjointSetList.push_back(std::move(disjointSet));
-	}
-
-	Vec4 colors[10] = {
-		{0,0,0,1},
-		{0,0,1,1},
-		{0,1,0,1},
-		{0,1,1,1},
-		{1,0,0,1},
-		{1,0,1,1},
-		{1,1,0,1},
-		{1,1,1,1},
-		{0.5,0.5,0.5,1},
-		{0.5,1,0,1}
-	};
+		float rn1 = dot(r1, c.collisionPoints[i].normal);
+		float rn2 = dot(r2, c.collisionPoints[i].normal);
+		float kNormal = (1.0f / bodyA.mass) + (1.0f / bodyB.mass);
+		kNormal += (1.0f / bodyA.momentOfInertia) * (dot(r1, r1) - rn1 * rn1) + (1.0f / bodyB.momentOfInertia) * (dot(r2, r2) - rn2 * rn2);
+		c.collisionPoints[i].massNormal = 1.0f / kNormal;
 
-	//int i = 0;
-	//for (auto & el : disjointSetList) {
-	//	std::cout << "islandset " << i << " has " << el.size() << " elements" << std::endl;
-	//
-	//	for (auto const& c : el) {
-	//		auto p1 = world.getComp<Transform>(c.idA).position;
-	//		auto p2 = world.getComp<Transform>(c.idB).position;
-	//		auto sprites = makeArrow(p2 - p1, p1, colors[i]);
-	//		for (auto s : sprites) {
-	//			EngineCore::renderer.submit(s, LAYER_WORLD_FOREGROUND);
-	//		}
-	//	}
-	//	++i;
-	//}
-}
+		float rt1 = dot(r1, tangent);
+		float rt2 = dot(r2, tangent);
+		float kTangent = (1 / bodyA.mass) + (1 / bodyB.mass);
+		kTangent += (1 / bodyA.momentOfInertia) * (dot(r1, r1) - rt1 * rt1) + (1 / bodyB.momentOfInertia) * (dot(r2, r2) - rt2 * rt2);
+		c.collisionPoints[i].massTangent = 1.0f / kTangent;
 
-void PhysicsSystem2::prepareConstraints(CollisionSECM world, float deltaTime)
-{
-	const float k_allowedPenetration = 0.01f;
-	float k_biasFactor = settings.positionCorrection ? 0.2f : 0.0f;
+		if (settings.accumulateImpulses) {
+			// Apply normal + friction impulse
+			Vec2 P = (c.collisionPoints[i].accPn * c.collisionPoints[i].normal + c.collisionPoints[i].accPt * tangent) * restitution;
 
-	for (auto& c : collConstraints) {
-		const EntityHandle entA = c.idA;
-		const EntityHandle entB = c.idB;
-		auto movementDummy = Movement();
-		auto& baseA = world.getComp<Transform>(entA);
-		auto& moveA = world.hasComp<Movement>(entA) ? world.getComp<Movement>(entA) : movementDummy;
-		auto& bodyA = world.getComp<PhysicsBody>(entA);
-		auto& baseB = world.getComp<Transform>(entB);
-		auto& moveB = world.hasComp<Movement>(entB) ? world.getComp<Movement>(entB) : movementDummy;
-		auto& bodyB = world.getComp<PhysicsBody>(entB);
-
-		c.friction = sqrt(bodyA.friction * bodyB.friction);
-		float restitution = 1.0f + std::max(bodyA.elasticity, bodyB.elasticity);
-		c.bias = -k_biasFactor * (1.0f / deltaTime) * std::min(0.0f, -c.clippingDist + k_allowedPenetration);
-
-		for (int i = 0; i < c.collisionPointNum; i++) {
-			Vec2 tangent = rotate<270>(c.collisionPoints[i].normal);
-			Vec2 r1 = c.collisionPoints[i].position - baseA.position;
-			Vec2 r2 = c.collisionPoints[i].position - baseB.position;
-
-			float rn1 = dot(r1, c.collisionPoints[i].normal);
-			float rn2 = dot(r2, c.collisionPoints[i].normal);
-			float kNormal = (1.0f / bodyA.mass) + (1.0f / bodyB.mass);
-			kNormal += (1.0f / bodyA.momentOfInertia) * (dot(r1, r1) - rn1 * rn1) + (1.0f / bodyB.momentOfInertia) * (dot(r2, r2) - rn2 * rn2);
-			c.collisionPoints[i].massNormal = 1.0f / kNormal;
-
-			float rt1 = dot(r1, tangent);
-			float rt2 = dot(r2, tangent);
-			float kTangent = (1 / bodyA.mass) + (1 / bodyB.mass);
-			kTangent += (1 / bodyA.momentOfInertia) * (dot(r1, r1) - rt1 * rt1) + (1 / bodyB.momentOfInertia) * (dot(r2, r2) - rt2 * rt2);
-			c.collisionPoints[i].massTangent = 1.0f / kTangent;
-
-			if (settings.accumulateImpulses) {
-				// Apply normal + friction impulse
-				Vec2 P = (c.collisionPoints[i].accPn * c.collisionPoints[i].normal + c.collisionPoints[i].accPt * tangent) * restitution;
-
-				moveA.velocity -= (1.0f / bodyA.mass) * P;
-				moveA.angleVelocity -= (1.0f / bodyA.momentOfInertia) * cross(r1, P);
-
-				moveB.velocity += (1.0f / bodyB.mass) * P;
-				moveB.angleVelocity += (1.0f / bodyB.momentOfInertia) * cross(r2, P);
-			}
+			moveA.velocity -= (1.0f / bodyA.mass) * P;
+			moveA.angleVelocity -= (1.0f / bodyA.momentOfInertia) * cross(r1, P);
+
+			moveB.velocity += (1.0f / bodyB.mass) * P;
+			moveB.angleVelocity += (1.0f / bodyB.momentOfInertia) * cross(r2, P);
 		}
 	}
 }
 
 PhysicsSystem2::PhysicsSystem2()
 {
-	disjointPairs.reserve(MAX_LAYERS);
+	colorOffsets.assign(MAX_COLORS + 2, 0);
 }
 
 void PhysicsSystem2::springyPositionCorrection(CollisionSECM world, float deltaTime)
@@ -318,6 +543,7 @@ void PhysicsSystem2::applyImpulse(CollisionSECM world, CollisionConstraint& c)
 void PhysicsSystem2::applyForcefields(CollisionSECM world, PhysicsUniforms const& uniform, float deltaTime)
 {
 	for (auto [ent, p, mov, base] : world.entityComponentView<PhysicsBody, Movement, Transform>()) {
+		if (mov.sleeping) continue;
 		mov.velocity += uniform.linearEffectDir * uniform.linearEffectAccel * deltaTime;
 		mov.velocity += uniform.linearEffectDir * uniform.linearEffectForce * (1.0f / world.getComp<PhysicsBody>(ent).mass) * deltaTime;
 		mov.velocity *= (1.0f - uniform.friction * deltaTime);
@@ -325,17 +551,192 @@ void PhysicsSystem2::applyForcefields(CollisionSECM world, PhysicsUniforms const
 	}
 }
 
+void PhysicsSystem2::checkSleepingIslands(CollisionSECM world)
+{
+	for (uint32_t island = 0; island < sleepingIslands.size(); ++island) {
+		if (!settings.allowSleeping && !sleepingIslands[island].bodies.empty()) {
+			wakeIsland(world, island);
+			continue;
+		}
+		for (const SleepingBody& body : sleepingIslands[island].bodies) {
+			if (!world.isHandleValid(body.handle) || !world.hasComps<Movement, Transform>(body.handle)) {
+				wakeIsland(world, island);
+				break;
+			}
+			const Movement& movement = world.getComp<Movement>(body.handle);
+			const Transform& transform = world.getComp<Transform>(body.handle);
+			if (!movement.sleeping ||
+				movement.velocity != Vec2{ 0, 0 } ||
+				movement.angleVelocity != 0.0f ||
+				transform.position != body.transform.position ||
+				!(transform.rotaVec == body.transform.rotaVec)) {
+				wakeIsland(world, island);
+				break;
+			}
+		}
+	}
+}
+
+void PhysicsSystem2::wakeBody(CollisionSECM world, EntityHandleIndex body)
+{
+	if (sleepingIslandOf[body] != NO_ISLAND) {
+		wakeIsland(world, sleepingIslandOf[body]);
+	}
+	else {
+		// a body put to sleep from outside of the physics has no island:
+		world.getComp<Movement>(body).sleeping = false;
+		sleepTimes[body] = 0.0f;
+	}
+}
+
+void PhysicsSystem2::wakeIsland(CollisionSECM world, uint32_t island)
+{
+	SleepingIsland& sleeping = sleepingIslands[island];
+	for (const SleepingBody& body : sleeping.bodies) {
+		const EntityHandleIndex index = body.handle.index;
+		if (index < sleepingIslandOf.size() && sleepingIslandOf[index] == island) {
+			sleepingIslandOf[index] = NO_ISLAND;
+			sleepTimes[index] = 0.0f;
+		}
+		if (world.isHandleValid(body.handle) && world.hasComp<Movement>(body.handle)) {
+			world.getComp<Movement>(body.handle).sleeping = false;
+		}
+	}
+	// the constraints are solved again in this execute, the next collision detection finds them again:
+	for (CollisionConstraint c : sleeping.constraints) {
+		if (world.isHandleValid(c.idA) && world.isHandleValid(c.idB) && 
+			world.hasComp<PhysicsBody>(c.idA) && world.hasComp<PhysicsBody>(c.idB) && 
+			!collConstraints.contains(c.idA, c.idB)) {
+			c.updated = true;
+			collConstraints.insert(c.idA, c.idB, c);
+		}
+	}
+	sleepingBodyCount -= sleeping.bodies.size();
+	sleeping.bodies.clear();
+	sleeping.constraints.clear();
+	freeSleepingIslands.push_back(island);
+}
+
+void PhysicsSystem2::updateSleep(CollisionSECM world, float deltaTime)
+{
+	const uint32_t entityCount = uint32_t(world.maxEntityIndex());
+	if (settings.solverMode != SolverMode::Islands) {
+		unionIslands(world);
+	}
+
+	// a contact in a jittering stack can be lost for a few frames, the bodies of a lost contact stay in the same island, 
+	// until the contact is found again or a quarter of timeToSleep passed, so a part of the stack can not fall asleep without the bodies it rests on.
+	// A longer time would glue the loose bodies of a pile together, so it would take longer until all of them rest at the same time:
+	for (uint32_t i = uint32_t(lostContacts.size()); i-- > 0;) {
+		LostContact& lost = lostContacts[i];
+		lost.time += deltaTime;
+		if (lost.time > settings.timeToSleep * 0.25f ||
+			!world.isHandleValid(lost.a) || !world.isHandleValid(lost.b) ||
+			collConstraints.contains(lost.a, lost.b)) {
+			lost = lostContacts.back();
+			lostContacts.pop_back();
+			continue;
+		}
+		if (world.hasComp<Movement>(lost.a) && world.hasComp<Movement>(lost.b) &&
+			!world.getComp<Movement>(lost.a).sleeping && !world.getComp<Movement>(lost.b).sleeping) {
+			uniteIslands(lost.a.index, lost.b.index);
+		}
+	}
+
+	// a body rests, while its mean velocity over a window of timeToSleep stays below the tolerances,
+	// so it may not leave the area around the transform at the start of the window, that it would cross in timeToSleep at the tolerated velocity.
+	// Bodies in a pile jitter, the mean velocity of a jittering body is near zero, while its velocity in one frame is not.
+	// An island can sleep, when its most restless body rested for timeToSleep. Particles never rest:
+	const float maxDrift = settings.linearSleepTolerance * settings.timeToSleep;
+	const float maxAngleDrift = settings.angularSleepTolerance * settings.timeToSleep;
+	restWindows.resize(entityCount);
+	islandSleepTimes.assign(entityCount, std::numeric_limits<float>::max());
+	for (auto [ent, body, movement, transform] : world.entityComponentView<PhysicsBody, Movement, Transform>()) {
+		if (movement.sleeping) continue;
+		const bool particle = world.hasComp<Collider>(ent) && world.getComp<Collider>(ent).particle;
+		RestWindow& window = restWindows[ent.index];
+		const Vec2 rotaDrift{ transform.rotaVec.sin - window.start.rotaVec.sin, transform.rotaVec.cos - window.start.rotaVec.cos };	// chord, about the angle for small angles
+		if (particle || sleepTimes[ent.index] == 0.0f || 
+			length(transform.position - window.start.position) > maxDrift || 
+			length(rotaDrift) > maxAngleDrift) {
+			sleepTimes[ent.index] = particle ? 0.0f : deltaTime;
+			window = RestWindow{ transform, 0.0f };
+		}
+		else {
+			sleepTimes[ent.index] += deltaTime;
+			window.time += deltaTime;
+			// the window slides, so a long resting body may creep at less than the tolerated velocity:
+			if (window.time >= settings.timeToSleep) {
+				window = RestWindow{ transform, 0.0f };
+			}
+		}
+		float& islandTime = islandSleepTimes[findIsland(ent.index)];
+		islandTime = std::min(islandTime, sleepTimes[ent.index]);
+	}
+
+	// the bodies of every resting island go into one sleeping island:
+	sleepingIslandOfRoot.assign(entityCount, NO_ISLAND);
+	bool anyFellAsleep = false;
+	for (auto [ent, body, movement] : world.entityComponentView<PhysicsBody, Movement>()) {
+		if (movement.sleeping) continue;
+		const uint32_t root = findIsland(ent.index);
+		if (islandSleepTimes[root] < settings.timeToSleep) continue;
+		uint32_t& island = sleepingIslandOfRoot[root];
+		if (island == NO_ISLAND) {
+			if (freeSleepingIslands.empty()) {
+				island = uint32_t(sleepingIslands.size());
+				sleepingIslands.push_back(SleepingIsland{});
+			}
+			else {
+				island = freeSleepingIslands.back();
+				freeSleepingIslands.pop_back();
+			}
+		}
+		sleepingIslands[island].bodies.push_back(SleepingBody{ ent, world.getComp<Transform>(ent) });
+		sleepingIslandOf[ent.index] = island;
+		sleepingBodyCount += 1;
+		movement.sleeping = true;
+		movement.velocity = Vec2{ 0, 0 };
+		movement.angleVelocity = 0.0f;
+		anyFellAsleep = true;
+	}
+	if (!anyFellAsleep) return;
+
+	// all constraints of a sleeping body belong to its island, as every other dynamic body it touches is in the same island.
+	// Erasing moves the last constraint to the erased index, so the constraints are visited from the back:
+	for (uint32_t i = uint32_t(collConstraints.size()); i-- > 0;) {
+		const CollisionConstraint& c = collConstraints[i];
+		const EntityHandleIndex body = world.hasComp<Movement>(c.idA) ? c.idA.index : c.idB.index;
+		if (sleepingIslandOf[body] != NO_ISLAND) {
+			sleepingIslands[sleepingIslandOf[body]].constraints.push_back(c);
+			collConstraints.erase(i);
+		}
+	}
+}
+
 void PhysicsSystem2::execute(CollisionSECM world, PhysicsUniforms const& uniform, float deltaTime, CollisionSystem& collSys)
 {
 	deltaTime = std::min(deltaTime, settings.minDelaTime);
 	debugSprites.clear();
 
 	//LOG_FUNCTION_TIME("clearDuplicates",clearDuplicates(world, collSys));
+	sleepingIslandOf.resize(world.maxEntityIndex(), NO_ISLAND);
+	sleepTimes.resize(world.maxEntityIndex(), 0.0f);
+	checkSleepingIslands(world);
 	updateCollisionConstraints(world, collSys);
 	eraseDeadConstraints();
+	if (settings.solverMode == SolverMode::GraphColored) {
+		orderConstraints();
+		colorConstraints(world);
+	}
+	else if (settings.solverMode == SolverMode::Islands) {
+		orderConstraints();
+		buildIslands(world);
+	}
 	if (settings.positionCorrection) springyPositionCorrection(world, deltaTime);
 	prepareConstraints(world, deltaTime);
 	applyImpulses(world);
+	if (settings.allowSleeping) updateSleep(world, deltaTime);
 	applyForcefields(world, uniform, deltaTime);
 	//drawAllCollisionConstraints();
 }
\ No newline at end of file
@@ -17,12 +17,24 @@
 * implement settings for iteration count of force and penetratin constraints
 */
 
+enum class SolverMode {
+	Sequential,		// all constraints are solved on one thread, in the order of the constraint set
+	GraphColored,	// constraints are colored so that no two constraints of a color share a dynamic body, every color is solved in parallel batches
+	Islands,		// bodies connected by constraints form islands, that are solved in parallel jobs, large islands are colored like in GraphColored
+};
+
 struct PhysicsSystemSettings {
 	bool positionCorrection = true;
 	bool accumulateImpulses = true;
-	bool warmStart = true;
+	bool warmStart = true;			// keeps the accumulated impulses of contact points with the same features as in the last frame
 	float minDelaTime = 0.2f;		// if deltaTime is bigger, the simulation will slow down to maintain precision
-	int impulseResolutionIterations = 15;
+	int impulseResolutionIterations = 8;
+	SolverMode solverMode = SolverMode::Sequential;
+	bool deterministicOrder = false;	// colors and groups the constraints in the order of their entity pairs, so the result does not depend on the order of the collisions
+	bool allowSleeping = true;			// islands whose bodies all rested for timeToSleep are taken out of the simulation, until they are touched, pushed or moved
+	float linearSleepTolerance = 0.05f;	// bodies whose mean velocity over timeToSleep is lower are resting
+	float angularSleepTolerance = 0.3f;	// radians per second
+	float timeToSleep = 0.5f;			// seconds
 };
 
 class PhysicsSystem2 {
@@ -31,22 +43,50 @@ public:
 	void execute(CollisionSECM world, PhysicsUniforms const& uniform, float deltaTime, CollisionSystem& collSys);
 	const std::vector<Sprite>& getDebugSprites() const;
 
+	/**
+	 * \return count of sleeping bodies after the last execute.
+	 */
+	size_t getSleepingBodyCount() const { return sleepingBodyCount; }
+
 	PhysicsSystemSettings settings;
 private:
 	std::vector<Sprite> debugSprites;
 	void updateCollisionConstraints(CollisionSECM world, CollisionSystem& collSys);
+	void updateCollisionPoints(CollisionConstraint& constraint, const CollisionInfo& collinfo);
 	void eraseDeadConstraints();
 	void prepareConstraints(CollisionSECM world, float deltaTime);
+	void prepareConstraint(CollisionSECM world, CollisionConstraint& c, float deltaTime);
 	void springyPositionCorrection(CollisionSECM world, float deltaTime);
 	void applyImpulse(CollisionSECM world, CollisionConstraint& c);
 	void applyImpulses(CollisionSECM world);
+	void orderConstraints();
+	void colorConstraints(CollisionSECM world);
+	template<typename F>
+	void forEachConstraintColored(F&& function);
+	void unionIslands(CollisionSECM world);
+	void buildIslands(CollisionSECM world);
+	uint32_t findIsland(uint32_t body);
+	void uniteIslands(uint32_t a, uint32_t b);
+	template<typename F>
+	void forEachSmallIsland(F&& function);
 	void applyForcefields(CollisionSECM world, PhysicsUniforms const& uniform, float deltaTime);
+	/**
+	 * wakes the sleeping islands with a destroyed, woken, pushed or moved body, or all of them if sleeping is not allowed.
+	 */
+	void checkSleepingIslands(CollisionSECM world);
+	/**
+	 * wakes the island of a sleeping body and gives its constraints back to the constraint set.
+	 */
+	void wakeBody(CollisionSECM world, EntityHandleIndex body);
+	void wakeIsland(CollisionSECM world, uint32_t island);
+	/**
+	 * advances the rest timers of the awake bodies and puts the islands to sleep, whose bodies all rested for timeToSleep.
+	 */
+	void updateSleep(CollisionSECM world, float deltaTime);
 	void drawAllCollisionConstraints();
 
 	/* EXPERIMENTAL */
 	void clearDuplicates(CollisionSECM world, CollisionSystem& collSys);
-	/* EXPERIMENTAL */
-	void findIslands(CollisionSECM world, CollisionSystem& collSys);
 
 
 	CollisionConstraintSet collConstraints;
@@ -56,10 +96,54 @@ private:
 
 	std::vector<bool> visited;
 	std::vector<bool> used;
-	const int MAX_LAYERS = 10;
-	const int CONSTRAINTS_PER_JOB = 5000;
-	std::vector<std::vector<CollisionConstraint*>> disjointPairs;
-	std::vector<CollisionConstraint*> restConstraints;
+
+	static constexpr uint32_t MAX_COLORS{ 32 };					// constraints that find no free color are solved on one thread after the colors
+	static constexpr size_t MIN_CONSTRAINTS_PER_BATCH{ 256 };	// smaller colors are solved on the calling thread
+	std::vector<uint32_t> constraintOrder;		// indices into collConstraints in coloring order, in island mode only the ones of large islands
+	std::vector<uint32_t> constraintColors;		// color of every constraint, MAX_COLORS for the overflow
+	std::vector<uint32_t> colorOffsets;			// MAX_COLORS + 2 offsets into coloredConstraints, the range after the colors holds the overflow
+	std::vector<uint32_t> coloredConstraints;	// indices into collConstraints, grouped by color
+	std::vector<uint32_t> bodyColorMasks;		// colors used by the constraints of every dynamic body, indexed by entity
+
+	static constexpr uint32_t NO_ISLAND{ 0xFFFFFFFF };
+	static constexpr size_t SPLIT_ISLAND_CONSTRAINTS{ 1024 };	// bigger islands are colored and solved in parallel batches instead of in one job
+	static constexpr size_t MIN_ISLANDS_PER_BATCH{ 16 };
+	std::vector<uint32_t> islandParents;			// union-find forest over the bodies, the root of an island is its lowest entity index
+	std::vector<uint32_t> islandOfRoot;				// island index of every root, indexed by entity
+	std::vector<uint32_t> constraintIslandRoots;	// island root of every constraint
+	std::vector<uint32_t> islandOffsets;			// island count + 1 offsets into islandConstraints
+	std::vector<uint32_t> islandCursors;			// next free index in islandConstraints of every island, while they are grouped
+	std::vector<uint32_t> islandConstraints;		// indices into collConstraints, grouped by island
+	std::vector<uint32_t> smallIslands;				// islands that are solved in one job each
+	size_t smallIslandConstraintCount{ 0 };
+
+	// sleeping islands keep the constraints of their bodies, so they can be solved again right after waking up:
+	struct SleepingBody {
+		EntityHandle handle;
+		Transform transform;	// as it was when the island fell asleep
+	};
+	struct SleepingIsland {
+		std::vector<SleepingBody> bodies;				// empty for free slots
+		std::vector<CollisionConstraint> constraints;
+	};
+	std::vector<SleepingIsland> sleepingIslands;
+	std::vector<uint32_t> freeSleepingIslands;
+	std::vector<uint32_t> sleepingIslandOf;		// indexed by entity, NO_ISLAND for awake bodies
+	std::vector<uint32_t> sleepingIslandOfRoot;	// indexed by entity, island that a root is put into in updateSleep
+	std::vector<float> sleepTimes;				// seconds every body rested, 0 if it did not start to rest, indexed by entity
+	struct RestWindow {
+		Transform start;	// transform at the start of the window
+		float time;			// seconds since the start of the window
+	};
+	std::vector<RestWindow> restWindows;		// indexed by entity
+	std::vector<float> islandSleepTimes;		// lowest rest time of the bodies of every island, indexed by root
+	struct LostContact {
+		EntityHandle a;
+		EntityHandle b;
+		float time;			// seconds since the contact was lost
+	};
+	std::vector<LostContact> lostContacts;		// recently lost contacts, they still connect islands in updateSleep
+	size_t sleepingBodyCount{ 0 };
 };
 
 #define LOG_FUNCTION_TIME(message, function) \
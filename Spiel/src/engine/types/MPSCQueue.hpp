@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cassert>
+#include <atomic>
+#include <memory>
+#include <cinttypes>
+
+/**
+ * Bounded lock-free queue with many producers and one consumer.
+ * Producers may push from any thread at the same time, popping is only allowed from one thread at a time.
+ * Every cell carries a sequence number that tells producers and the consumer if the cell is free or filled,
+ * so a push is one CAS on the write position and no locks are taken.
+ */
+template<typename T>
+class MPSCQueue {
+public:
+	/**
+	 * \param capacity is rounded up to the next power of two.
+	 */
+	MPSCQueue(size_t capacity = 1024)
+	{
+		reset(capacity);
+	}
+
+	/**
+	 * Can be called from any thread.
+	 *
+	 * \return false if the queue is full.
+	 */
+	bool tryPush(T const& value)
+	{
+		return tryPushImpl(value);
+	}
+	bool tryPush(T&& value)
+	{
+		return tryPushImpl(std::move(value));
+	}
+
+	/**
+	 * Only one thread may pop at a time.
+	 *
+	 * \return false if the queue is empty.
+	 */
+	bool tryPop(T& value)
+	{
+		Cell& cell = cells[readPos & mask];
+		const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if (sequence != readPos + 1) {
+			return false;
+		}
+		value = std::move(cell.data);
+		cell.sequence.store(readPos + mask + 1, std::memory_order_release);
+		++readPos;
+		return true;
+	}
+
+	size_t capacity() const { return mask + 1; }
+
+	/**
+	 * Discards all queued elements and reallocates the cells.
+	 * Must not be called while any thread pushes or pops.
+	 */
+	void reset(size_t newCapacity)
+	{
+		size_t capacity = 1;
+		while (capacity < newCapacity) capacity <<= 1;
+		cells = std::make_unique<Cell[]>(capacity);
+		for (size_t i = 0; i < capacity; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		mask = capacity - 1;
+		writePos.store(0, std::memory_order_relaxed);
+		readPos = 0;
+	}
+private:
+	template<typename U>
+	bool tryPushImpl(U&& value)
+	{
+		size_t pos = writePos.load(std::memory_order_relaxed);
+		Cell* cell;
+		while (true) {
+			cell = &cells[pos & mask];
+			const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = writePos.load(std::memory_order_relaxed);
+			}
+		}
+		cell->data = std::forward<U>(value);
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	struct Cell {
+		std::atomic<size_t> sequence{ 0 };
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask{ 0 };
+	alignas(64) std::atomic<size_t> writePos{ 0 };
+	alignas(64) size_t readPos{ 0 };
+};
@@ -29,10 +29,11 @@ Game::Game() : EngineCore{ "Balls2", 1600, 900 }
 	renderer.supersamplingFactor = 1.0f;
 
 	collisionSystem.disableColliderDetection(Collider::PARTICLE);
+	events.registerChannel<OutOfBoundsEvent>();
 }
 
 void Game::create() {
-	world.setOnRemCallback<Health>(onHealthRemCallback);
+	world.addOnRemCallback<Health>(onHealthRemCallback);
 	renderer.camera.zoom = 0.1;
 
 #ifdef _DEBUG
@@ -250,10 +251,9 @@ void Game::gameplayUpdate(float deltaTime)
 
 	cursorManipFunc();
 
-	for (auto ent : world.entityView<Movement, Transform>()) {
-		auto pos = world.getComp<Transform>(ent).position;
-		if (length(pos) > 1000)
-			world.destroy(ent);
+	// the movement jobs are finished, so no thread emits anymore:
+	for (const auto& event : events.drain<OutOfBoundsEvent>()) {
+		world.destroy(event.entity);
 	}
 }
 
@@ -270,17 +270,15 @@ void Game::cursorManipFunc()
 {
 	Vec2 worldCoord = renderer.getCoordSys().convertCoordSys<RenderSpace::Window, RenderSpace::Camera>(mainWindow.getCursorPos());
 	Vec2 worldVel = (cursorData.oldPos - worldCoord) * getDeltaTimeSafe();
-	Transform b = Transform(worldCoord, 0);
-	Collider c = Collider({ 0.02,0.02 }, Form::Circle);
 	//renderer.submit(
 	//	Sprite(0, worldCoord, 2.0f, Vec2(0.02, 0.02) / renderer.camera.zoom, Vec4(1, 0, 0, 1), Form::Circle, RotaVec2(0), //RenderSpace::WorldSpace),
 	//	LAYER_FIRST_UI
 	//);
 	if (!cursorData.locked && mainWindow.buttonPressed(MouseButton::MB_LEFT)) {
-		std::vector<CollisionInfo> collisions;
-		collisionSystem.checkForCollisions(collisions, Collider::DYNAMIC | Collider::SENSOR | Collider::STATIC | Collider::PARTICLE, b, c);
-		if (!collisions.empty()) {
-			EntityHandleIndex topEntity = collisions.front().indexB;
+		cursorData.hovered.clear();
+		collisionSystem.querryPoint(cursorData.hovered, worldCoord, Collider::DYNAMIC | Collider::SENSOR | Collider::STATIC | Collider::PARTICLE);
+		if (!cursorData.hovered.empty()) {
+			EntityHandleIndex topEntity = cursorData.hovered.front();
 			EntityHandle id = world.getHandle(topEntity);
 			cursorData.relativePos = world.getComp<Transform>(topEntity).position - worldCoord;
 			cursorData.lockedID = id;
@@ -518,24 +516,21 @@ void Game::spawnBall()
 {
 	Vec2 scale = Vec2(0.2f, 0.2f);
 	Form form = Form::Circle;
-	Collider trashCollider = Collider(scale, form);
 	PhysicsBody trashSolidBody = PhysicsBody(0.2f, 0.5f, calcMomentOfIntertia(0.5, scale), 0.9f);
 	for (int i = 0; i < 10; i++) {
 		float factor = (rand() % 1000) / 600.0f + 0.7f;
 		auto sscale = scale * factor;
 		form = Form::Circle;
-		trashCollider = Collider(sscale, form);
 
-		trashCollider.form = form;
 		Vec4 color = Vec4(rand() % 1000 / 1000.0f, rand() % 1000 / 1000.0f, rand() % 1000 / 1000.0f, 1);
 		Vec2 position = { 20 + rand() % 1000 / 500.0f + 1.0f,60 + rand() % 1000 / 500.0f + 1.0f };
 		auto trash = world.create();
-		world.addComp(trash, Transform(position, RotaVec2(0)));
-		world.addComp(trash, Movement());
-		world.addComp(trash, trashCollider);
+		world.emplaceComp<Transform>(trash, position, RotaVec2(0));
+		world.addComp<Movement>(trash);
+		world.emplaceComp<Collider>(trash, sscale, form);
 		world.addComp(trash, trashSolidBody);
-		world.addComp(trash, Draw(color, sscale, 0.5f, form));
-		world.addComp(trash, Health(100));
+		world.emplaceComp<Draw>(trash, color, sscale, 0.5f, form);
+		world.emplaceComp<Health>(trash, 100);
 		world.addComp(trash, TextureLoadInfo{ "ressources/Dir.png" });
 		world.spawn(trash);
 	}
@@ -8,6 +8,7 @@
 #include "../engine/gui/GUIManager.hpp"
 
 #include "../engine/EngineCore.hpp"
+#include "../engine/EventSystem.hpp"
 #include "World.hpp"
 using Coll = Collider;
 using Move = Movement;
@@ -24,6 +25,14 @@ struct CursorManipData {
 	Vec2 relativePos;
 	LapTimer ballSpawnLap;
 	LapTimer wallSpawnLap;
+	std::vector<EntityHandleIndex> hovered;	// reused buffer for the cursor querry
+};
+
+/**
+ * emitted by the movement jobs for entities that left the world, they are destroyed in gameplayUpdate.
+ */
+struct OutOfBoundsEvent {
+	EntityHandle entity;
 };
 
 class Game : public EngineCore {
@@ -51,6 +60,7 @@ public:
 	World world;
 
 	CursorManipData cursorData;
+	EventSystem events;
 	CollisionSystem collisionSystem{ world.submodule<COLLISION_SECM_COMPONENTS>() };
 	PhysicsSystem2 physicsSystem2;
 
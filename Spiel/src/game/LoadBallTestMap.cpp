@@ -1,14 +1,16 @@
 #include "LoadBallTestMap.hpp"
 
+#include "../engine/collision/TilemapColliderBuilder.hpp"
+
 void loadBallTestMap(Game& game)
 {
 	auto& world = game.world;
-	auto makeWall = [&](float x, float y) {
+	auto makeWall = [&](Vec2 pos, Vec2 size) {
 		auto wall = world.create();
 		auto comp = world.componentView(wall);
-		comp.add<Transform>(Transform(Vec2(x, y), 0));
-		comp.add<Draw>(Draw(Vec4(0.8, 0.8, 0.8, 1), Vec2(1.2, 1.2), 0.45f, Form::Rectangle));
-		auto coll = Collider(Vec2(1.2, 1.2), Form::Rectangle);
+		comp.add<Transform>(Transform(pos, 0));
+		comp.add<Draw>(Draw(Vec4(0.8, 0.8, 0.8, 1), size, 0.45f, Form::Rectangle));
+		auto coll = Collider(size, Form::Rectangle);
 		coll.setIgnore(Collider::DYNAMIC);
 		comp.add<Collider>(coll);
 		comp.add<PhysicsBody>(PhysicsBody(0.0f, 10000000000000000000000000000000000.0f, 1000000000000000000000000000000000.0f, 1));
@@ -105,14 +107,18 @@ void loadBallTestMap(Game& game)
 		"################################"
 	};
 
-	for (float vert = 0; vert < height - 0.001f; vert++) {
-		for (float hor = 0; hor < width - 0.001f; hor++) {
-			if (map.at(uint32_t(vert * width + hor)) == '#') {
-				//for (int i = 0; i < 100; i++)
-				makeWall(hor, height - vert);
-			}
+	// the walls are merged into few rectangles, the map string starts with the top row:
+	TilemapColliderBuilder tiles(width, height);
+	for (int vert = 0; vert < height; vert++) {
+		for (int hor = 0; hor < width; hor++) {
+			tiles.setSolid(hor, height - 1 - vert, map.at(vert * width + hor) == '#');
 		}
 	}
+	tiles.build();
+	for (const auto& rect : tiles.getRects()) {
+		if (rect.width == 0) continue;
+		makeWall(TilemapColliderBuilder::rectCenter(rect, Vec2(0, 1), 1.0f), TilemapColliderBuilder::rectSize(rect, 1.0f, Vec2(1.2, 1.2)));
+	}
 
 	//for (int i = 0; i < 100'000; i++) {
 	//	auto dummy = world.create();
@@ -126,9 +132,11 @@ void loadBallTestMap(Game& game)
 	auto cmps = world.componentView(player);
 	cmps.add<Transform>(Transform(Vec2(2, 12), 0));
 	auto colliderPlayer = Collider(Vec2(0.4, 0.7), Form::Rectangle);
-	colliderPlayer.extraColliders.push_back(CompountCollider(Vec2(1, 1) * 0.4, Vec2(0, 0.35), RotaVec2(0), Form::Circle));
-	colliderPlayer.extraColliders.push_back(CompountCollider(Vec2(0.3, 0.2), Vec2(0.2, -0.3), RotaVec2(305.0f), Form::Rectangle));
-	colliderPlayer.extraColliders.push_back(CompountCollider(Vec2(0.3, 0.2), Vec2(-0.2, -0.3), RotaVec2(55.0f), Form::Rectangle));
+	colliderPlayer.setExtraColliders({
+		CompountCollider(Vec2(1, 1) * 0.4, Vec2(0, 0.35), RotaVec2(0), Form::Circle),
+		CompountCollider(Vec2(0.3, 0.2), Vec2(0.2, -0.3), RotaVec2(305.0f), Form::Rectangle),
+		CompountCollider(Vec2(0.3, 0.2), Vec2(-0.2, -0.3), RotaVec2(55.0f), Form::Rectangle)
+	});
 	cmps.add(colliderPlayer);
 	cmps.add(PhysicsBody(0.0, 25.0f, calcMomentOfIntertia(25.0f, scalePlayer), 0.9f));
 	cmps.add<Movement>();
@@ -154,7 +162,6 @@ void loadBallTestMap(Game& game)
 
 	Vec2 scale = Vec2(0.2f, 0.2f);
 	Form form = Form::Circle;
-	Collider trashCollider = Collider(scale, form);
 	PhysicsBody trashSolidBody = PhysicsBody(0.2f, 0.5f, calcMomentOfIntertia(0.5, scale), 0.9f);
 	for (int i = 0; i < 10000; i++) {
 		//if (i % 2) {
@@ -167,18 +174,16 @@ void loadBallTestMap(Game& game)
 		float factor = (rand() % 1000) / 600.0f + 0.7f;
 		auto sscale = scale * factor;
 		form = Form::Circle;
-		trashCollider = Collider(sscale, form);
 		//}
-		trashCollider.form = form;
 		Vec4 color = Vec4(rand() % 1000 / 1000.0f, rand() % 1000 / 1000.0f, rand() % 1000 / 1000.0f, 1);
 		Vec2 position = { static_cast<float>(rand() % 1001 / 300.0f) * 4.6f + 5.5f, static_cast<float>(rand() % 1000 / 100.0f) * 4.6f + 5.5f };
 		auto trash = world.create();
-		world.addComp(trash, Transform(position, RotaVec2(0)));
-		world.addComp(trash, Movement());
-		world.addComp(trash, trashCollider);
+		world.emplaceComp<Transform>(trash, position, RotaVec2(0));
+		world.addComp<Movement>(trash);
+		world.emplaceComp<Collider>(trash, sscale, form);
 		world.addComp(trash, trashSolidBody);
-		world.addComp(trash, Draw(color, sscale, 0.5f, form));
-		world.addComp(trash, Health(100));
+		world.emplaceComp<Draw>(trash, color, sscale, 0.5f, form);
+		world.emplaceComp<Health>(trash, 100);
 		world.addComp(trash, TextureLoadInfo{ "ressources/Dir.png" });
 		world.spawn(trash);
 	}
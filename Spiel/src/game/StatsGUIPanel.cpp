@@ -8,7 +8,7 @@ GUIStatsPanel::GUIStatsPanel(Game* game):
 	Manager& gui = game->gui;
 	rootHandle = gui.build(Root{
 		.onUpdate = [&](Root& self,u32 id) { update(); },
-		.sizing = Sizing{}.absX(200).absY(300),
+		.sizing = Sizing{}.absX(200).absY(400),
 		.placing = Placing{}.absDistLeft(20).absDistTop(40),
 		.child = gui.build(Box{
 			.bFillSpace = true,
@@ -26,6 +26,14 @@ GUIStatsPanel::GUIStatsPanel(Game* game):
 					}),
 					gui.build(Text{.value = &entityCountStr}),
 					gui.build(Text{.value = &fpsStr}),
+					gui.build(Text{.value = &frameArenaStr}),
+					gui.build(Text{.value = &staticRebuildStr}),
+					gui.build(Text{.value = &sleepingStr}),
+					gui.build(Text{.value = &narrowphaseStrs[0]}),
+					gui.build(Text{.value = &narrowphaseStrs[1]}),
+					gui.build(Text{.value = &narrowphaseStrs[2]}),
+					gui.build(Text{.value = &narrowphaseStrs[3]}),
+					gui.build(Text{.value = &maskCullingStr}),
 					gui.build(SliderF64{
 						.value = &impResIterSliderValue, 
 						.min = 1.0f, 
@@ -57,5 +65,18 @@ void GUIStatsPanel::update()
 {
 	entityCountStr =	std::string("entitycount: ") + std::to_string(game->world.size());
 	fpsStr =			std::string("fps:         ") + std::to_string(std::ceilf(1.0f / game->getDeltaTime(20)));
+	const auto arenaStats = JobSystem::frameArenaStats();
+	frameArenaStr =		std::string("frame mem:   ") + std::to_string(arenaStats.lastFrameUsedBytes / 1024) + "/" + std::to_string(arenaStats.highWaterMark / 1024) + " KB";
+	staticRebuildStr =	std::string("static rebuilds: ") + std::to_string(game->collisionSystem.getStaticRebuildCount());
+	sleepingStr =		std::string("sleeping:    ") + std::to_string(game->physicsSystem2.getSleepingBodyCount());
+	// candidates/collisions of the narrowphase buckets:
+	const char* bucketNames[] = { "circ-circ: ", "circ-rect: ", "rect-rect: ", "compound:  " };
+	const auto& narrowphaseStats = game->collisionSystem.getNarrowphaseStats();
+	for (size_t bucket = 0; bucket < narrowphaseStats.size(); ++bucket) {
+		narrowphaseStrs[bucket] = std::string(bucketNames[bucket]) + std::to_string(narrowphaseStats[bucket].candidates) + "/" + std::to_string(narrowphaseStats[bucket].collisions);
+	}
+	// nodes and entities skipped by the group masks in the broadphases/candidates rejected by group mask after the broadphases:
+	const auto& maskStats = game->collisionSystem.getGroupMaskCullingStats();
+	maskCullingStr =	std::string("mask culled: ") + std::to_string(maskStats.culledNodes) + "/" + std::to_string(maskStats.culledEntities) + "/" + std::to_string(maskStats.rejectedCandidates);
 	game->physicsSystem2.settings.impulseResolutionIterations = cast<u32>(impResIterSliderValue);
 }
@@ -15,4 +15,9 @@ private:
 	f64 impResIterSliderValue{ 5.0f };
 	std::string entityCountStr;
 	std::string fpsStr;
+	std::string frameArenaStr;
+	std::string staticRebuildStr;
+	std::string sleepingStr;
+	std::array<std::string, size_t(ShapePairBucket::Count)> narrowphaseStrs;
+	std::string maskCullingStr;
 };
\ No newline at end of file
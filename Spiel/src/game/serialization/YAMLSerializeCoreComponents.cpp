@@ -41,7 +41,7 @@ YAML::Emitter& operator<<(YAML::Emitter& out, const Collider& c)
 	out << YAML::Key << "Size" << YAML::Value << c.size;
 	out << YAML::Key << "IgnoreMask" << YAML::Value << c.ignoreGroupMask;
 	out << YAML::Key << "Mask" << YAML::Value << c.groupMask;
-	out << YAML::Key << "ExtraCollider" << YAML::Value << c.extraColliders;
+	out << YAML::Key << "ExtraCollider" << YAML::Value << std::vector<CompountCollider>(c.extraColliders().begin(), c.extraColliders().end());
 	out << YAML::Key << "particle" << YAML::Value << c.particle;
 	out << YAML::Key << "Form" << YAML::Value << c.form;
 	out << YAML::Key << "IgnoreTypes";
@@ -98,7 +98,7 @@ namespace YAML {
             rhs.size                = node["Size"].as<Vec2>();
             rhs.ignoreGroupMask     = node["IgnoreMask"].as<CollisionMask>();
             rhs.groupMask           = node["Mask"].as<CollisionMask>();
-            rhs.extraColliders      = node["ExtraCollider"].as<std::vector<CompountCollider>>();
+            rhs.setExtraColliders(node["ExtraCollider"].as<std::vector<CompountCollider>>());
             rhs.particle            = node["particle"].as<bool>();
             rhs.form                = node["Form"].as<Form>();
             rhs.collisionSettings = 0x00;